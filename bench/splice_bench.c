@@ -0,0 +1,81 @@
+/*
+* liblsv benchmark: vmsplice() output against write()
+*
+*   splice_bench write LINES [--splice]
+*       writes LINES listing-like lines ("dir/file_NNNNNNNN.dat\n") to
+*       stdout through the buffered writer, with or without
+*       lsv_out_splice(), as lsv1.7.0 does for a long -1 listing
+*   splice_bench read
+*       drains stdin into /dev/null with splice(), a reader that never
+*       copies the data into its own memory
+*
+* `make bench-splice` times every writer against `cat >/dev/null` (a
+* copying reader) and the splicing reader.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/lsv.h"
+
+static int write_lines(unsigned long long lines, int splice)
+{
+    struct lsv_out *out = lsv_out_open(STDOUT_FILENO);
+    if (out == NULL) {
+        perror("lsv_out_open");
+        return 1;
+    }
+    if (splice)
+        lsv_out_splice(out);
+
+    for (unsigned long long i = 0; i < lines; i++) {
+        lsv_out_write(out, "/srv/data/file_", 15);
+        lsv_out_u64(out, 10000000 + i % 90000000);
+        lsv_out_write(out, ".dat\n", 5);
+    }
+    if (lsv_out_close(out) == -1) {
+        perror("write");
+        return 1;
+    }
+    return 0;
+}
+
+static int splice_drain(void)
+{
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null == -1) {
+        perror("/dev/null");
+        return 1;
+    }
+    for (;;) {
+        ssize_t n = splice(STDIN_FILENO, NULL, null, NULL, 1 << 20, SPLICE_F_MOVE);
+        if (n == 0)
+            break;
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("splice");
+            return 1;
+        }
+    }
+    close(null);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 3 && strcmp(argv[1], "write") == 0)
+        return write_lines(strtoull(argv[2], NULL, 10),
+                           argc > 3 && strcmp(argv[3], "--splice") == 0);
+    if (argc == 2 && strcmp(argv[1], "read") == 0)
+        return splice_drain();
+
+    fprintf(stderr, "Usage: %s write LINES [--splice] | %s read\n", argv[0], argv[0]);
+    return 2;
+}
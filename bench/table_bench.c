@@ -0,0 +1,225 @@
+/*
+* liblsv benchmark: entry table against a pointer table
+*
+* Lists one directory per round in the default column layout, both ways,
+* into /dev/null through the same buffered writer:
+*   - pointer table: one malloc()ed string per name in a char ** array,
+*     qsort() with strcasecmp() and strlen() in layout and padding, as
+*     do_ls() and print_in_columns() did up to v1.6.0;
+*   - entry table: lsv_dir_load() and the selected column renderer, with
+*     names in one blob and lengths, widths and sort keys in columns.
+* Both read the directory with readdir() and skip lstat(), so the rounds
+* differ only in how entries are stored, sorted and laid out. Prints the
+* best per-round CPU time of each (CLOCK_PROCESS_CPUTIME_ID) and, where
+* the CPU exposes hardware counters to perf_event_open(2), the user-space
+* cache misses and L1 data-cache read misses per round.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../src/lsv.h"
+
+#define TERM_WIDTH 80
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* ===============================================
+   Hardware Counters
+   =============================================== */
+enum { CTR_CACHE, CTR_L1D, NCTR };
+
+static const char *const ctr_names[NCTR] = { "cache misses", "L1d read misses" };
+
+/* Opens one user-space counter for this process; -1 with errno set when
+   the CPU (or a VM) has no such event */
+static int open_counter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr = {
+        .type = type,
+        .size = sizeof(attr),
+        .config = config,
+        .disabled = 1,
+        .exclude_kernel = 1,    // getdents() is the same for both tables
+        .exclude_hv = 1,
+    };
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void start_counters(const int *fd)
+{
+    for (int c = 0; c < NCTR; c++) {
+        if (fd[c] != -1) {
+            ioctl(fd[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void stop_counters(const int *fd, unsigned long long *total)
+{
+    for (int c = 0; c < NCTR; c++) {
+        uint64_t v;
+        if (fd[c] != -1) {
+            ioctl(fd[c], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd[c], &v, sizeof(v)) == (ssize_t)sizeof(v))
+                total[c] += v;
+        }
+    }
+}
+
+/* ===============================================
+   Rounds
+   =============================================== */
+static int compare_filenames(const void *a, const void *b)
+{
+    return strcasecmp(*(const char **)a, *(const char **)b);
+}
+
+static int pointer_round(const char *path, struct lsv_out *out)
+{
+    DIR *dp = opendir(path);
+    if (dp == NULL)
+        return -1;
+
+    char **names = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = realloc(names, cap * sizeof(*names));
+            if (names == NULL)
+                abort();
+        }
+        if ((names[count++] = strdup(entry->d_name)) == NULL)
+            abort();
+    }
+    closedir(dp);
+    qsort(names, count, sizeof(*names), compare_filenames);
+
+    size_t max_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(names[i]) > max_len)
+            max_len = strlen(names[i]);
+    }
+    size_t col_width = max_len + 2;
+    size_t columns = TERM_WIDTH / col_width ? TERM_WIDTH / col_width : 1;
+    size_t rows = (count + columns - 1) / columns;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < columns; c++) {
+            size_t idx = c * rows + r;
+            if (idx < count) {
+                lsv_out_puts(out, names[idx]);
+                lsv_out_pad(out, (int)(col_width - strlen(names[idx])));
+            }
+        }
+        lsv_out_putc(out, '\n');
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+    return 0;
+}
+
+static int table_round(const char *path, const struct lsv_options *opts,
+                       lsv_render_fn render, struct lsv_out *out)
+{
+    struct lsv_dir *dir = lsv_dir_load(path, opts);
+    if (dir == NULL)
+        return -1;
+    render(dir, opts, out);
+    lsv_dir_free(dir);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DIR [ROUNDS]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    struct lsv_out *out = fd == -1 ? NULL : lsv_out_open(fd);
+    if (out == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    struct lsv_options opts;
+    lsv_options_init(&opts);
+    opts.color = 0;     // no lstat() in the column layout
+    lsv_render_fn render = lsv_render_select(&opts);
+
+    int fd_ctr[NCTR], ctr_err[NCTR];
+    fd_ctr[CTR_CACHE] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    ctr_err[CTR_CACHE] = errno;
+    fd_ctr[CTR_L1D] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    ctr_err[CTR_L1D] = errno;
+    unsigned long long miss_ptr[NCTR] = { 0 }, miss_tab[NCTR] = { 0 };
+
+    double best_ptr = 0, best_tab = 0;
+    for (int r = 0; r < rounds; r++) {
+        double t0 = cpu_ms();
+        start_counters(fd_ctr);
+        if (pointer_round(path, out) == -1) {
+            perror(path);
+            return 1;
+        }
+        lsv_out_flush(out);
+        stop_counters(fd_ctr, miss_ptr);
+        double t1 = cpu_ms();
+        start_counters(fd_ctr);
+        if (table_round(path, &opts, render, out) == -1) {
+            perror(path);
+            return 1;
+        }
+        lsv_out_flush(out);
+        stop_counters(fd_ctr, miss_tab);
+        double t2 = cpu_ms();
+        if (r == 0 || t1 - t0 < best_ptr)
+            best_ptr = t1 - t0;
+        if (r == 0 || t2 - t1 < best_tab)
+            best_tab = t2 - t1;
+    }
+    lsv_out_close(out);
+    close(fd);
+
+    printf("pointer table  %8.1f ms\n", best_ptr);
+    printf("entry table    %8.1f ms\n", best_tab);
+    for (int c = 0; c < NCTR; c++) {
+        if (fd_ctr[c] == -1) {
+            printf("%-16s unavailable: %s\n", ctr_names[c], strerror(ctr_err[c]));
+            continue;
+        }
+        printf("%-16s pointer table %llu, entry table %llu per round\n", ctr_names[c],
+               miss_ptr[c] / (unsigned)rounds, miss_tab[c] / (unsigned)rounds);
+        close(fd_ctr[c]);
+    }
+    return 0;
+}
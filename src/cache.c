@@ -0,0 +1,296 @@
+/*
+* liblsv: directory cache for long-running processes (lsvd)
+*
+* Loaded entry tables are kept by the directory's (st_dev, st_ino) and
+* reused while they are provably current:
+*   - the directory's mtime and ctime still match, which catches names
+*     being added, removed or renamed, and
+*   - for stat'ed tables, an inotify watch set up before the load has not
+*     reported any change (attributes, writes, moves) to its entries.
+* lsv_cache_sync() reads pending inotify events and drops what they
+* touch: each watch descriptor maps to the list of entries it covers (one
+* directory can sit under two keys, e.g. across a bind mount, and inotify
+* gives both the same descriptor), so an event costs one lookup whatever
+* the cache's size. Without inotify only name-only tables are cached. Tables built
+* with a filter, sorted by the caller's locale (--collate) or that hit
+* read errors are never cached.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+#define LOAD_STAT  1    // entries were lstat()ed
+#define LOAD_WIDTH 2    // display widths were computed
+#define LOAD_LINKS 4    // symlink targets were read
+#define LOAD_SORT_SHIFT 3   // next 2 bits: the enum lsv_sort order
+#define LOAD_HIDDEN_SHIFT 5 // next 2 bits: the enum lsv_hidden mode
+
+#define WATCH_MASK (IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+struct cache_entry {
+    struct lsv_dir *dir;        // NULL: invalidated, reload on next use
+    int             wd;         // inotify watch, -1 if none
+    struct cache_entry *wd_next;    // next entry on the same watch
+    int             load;       // LOAD_* flags dir was built with
+    struct timespec mtime;
+    struct timespec ctime;
+    int             in_use;     // handed out by cache_get(), not yet put back
+    int             stale;      // invalidated while in use
+    int             orphan;     // evicted while in use: free on put
+};
+
+struct lsv_cache {
+    struct strmap map;          // (dev, ino) -> struct cache_entry *
+    struct strmap watches;      // wd -> first struct cache_entry on it
+    size_t        max_dirs;
+    int           inotify_fd;   // -1 if unavailable
+};
+
+struct lsv_cache *lsv_cache_new(size_t max_dirs)
+{
+    struct lsv_cache *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return NULL;
+    c->max_dirs = max_dirs ? max_dirs : 1;
+    c->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return c;
+}
+
+/* Takes e off its watch's list; the last one off removes the watch */
+static void unwatch(struct lsv_cache *c, struct cache_entry *e)
+{
+    int wd = e->wd;
+    if (wd == -1)
+        return;
+    e->wd = -1;
+
+    const struct strmap_slot *s = strmap_find(&c->watches, (const char *)&wd, sizeof(wd));
+    struct cache_entry *head = s ? s->value : NULL;
+    if (head == e) {
+        head = e->wd_next;
+    } else {
+        for (struct cache_entry *p = head; p != NULL; p = p->wd_next) {
+            if (p->wd_next == e) {
+                p->wd_next = e->wd_next;
+                break;
+            }
+        }
+    }
+    e->wd_next = NULL;
+
+    if (head != NULL) {
+        strmap_put(&c->watches, (const char *)&wd, sizeof(wd), head);  // present: cannot fail
+        return;
+    }
+    strmap_remove(&c->watches, (const char *)&wd, sizeof(wd));
+    if (c->inotify_fd != -1)
+        inotify_rm_watch(c->inotify_fd, wd);
+}
+
+/* Puts e on the list of watch wd; without memory e stays unwatched, so
+   its stat'ed tables are not cached */
+static void watch(struct lsv_cache *c, struct cache_entry *e, int wd)
+{
+    if (e->wd == wd)
+        return;
+    unwatch(c, e);
+    if (wd == -1)
+        return;
+
+    const struct strmap_slot *s = strmap_find(&c->watches, (const char *)&wd, sizeof(wd));
+    struct cache_entry *head = s ? s->value : NULL;
+    if (strmap_put(&c->watches, (const char *)&wd, sizeof(wd), e) == NULL) {
+        if (head == NULL)
+            inotify_rm_watch(c->inotify_fd, wd);
+        return;
+    }
+    e->wd_next = head;
+    e->wd = wd;
+}
+
+/* Drops every entry; tables still in use are freed when put back */
+static void cache_clear(struct lsv_cache *c)
+{
+    for (size_t i = 0; i < c->map.cap; i++) {
+        if (c->map.slots[i].key == NULL)
+            continue;
+        struct cache_entry *e = c->map.slots[i].value;
+        unwatch(c, e);
+        if (e->in_use) {
+            e->orphan = 1;
+        } else {
+            lsv_dir_free(e->dir);
+            free(e);
+        }
+    }
+    strmap_free(&c->map, NULL);
+    strmap_free(&c->watches, NULL);
+}
+
+void lsv_cache_free(struct lsv_cache *c)
+{
+    if (c == NULL)
+        return;
+    cache_clear(c);
+    if (c->inotify_fd != -1)
+        close(c->inotify_fd);
+    free(c);
+}
+
+static void invalidate(struct cache_entry *e)
+{
+    if (e->in_use) {
+        e->stale = 1;
+    } else {
+        lsv_dir_free(e->dir);
+        e->dir = NULL;
+    }
+}
+
+/* Invalidates every entry on watch wd; gone: the kernel dropped it */
+static void invalidate_wd(struct lsv_cache *c, int wd, int gone)
+{
+    const struct strmap_slot *s = strmap_find(&c->watches, (const char *)&wd, sizeof(wd));
+    if (s == NULL)
+        return;
+
+    struct cache_entry *next;
+    for (struct cache_entry *e = s->value; e != NULL; e = next) {
+        next = e->wd_next;
+        invalidate(e);
+        if (gone) {
+            e->wd = -1;
+            e->wd_next = NULL;
+        }
+    }
+    if (gone)
+        strmap_remove(&c->watches, (const char *)&wd, sizeof(wd));
+}
+
+void lsv_cache_sync(struct lsv_cache *c)
+{
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int last_wd = -1;
+
+    ids_revalidate();
+    if (c->inotify_fd == -1)
+        return;
+
+    for (;;) {
+        ssize_t n = read(c->inotify_fd, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                cache_clear(c);     // events were lost: trust nothing
+                last_wd = -1;
+                continue;
+            }
+            int gone = (ev->mask & IN_IGNORED) != 0;
+            if (ev->wd != last_wd || gone)
+                invalidate_wd(c, ev->wd, gone);
+            last_wd = ev->wd;
+        }
+    }
+}
+
+static int same_time(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+/* Returns a cached table for path if one is current, else loads one
+   (and caches it when allowed). Pair every call with cache_put(). */
+struct lsv_dir *cache_get(struct lsv_cache *c, const char *path, const struct lsv_options *opts)
+{
+    struct stat st;
+    if (opts->filter != NULL || opts->sort == LSV_SORT_COLLATE ||
+        stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+        return lsv_dir_load(path, opts);
+
+    int load = (lsv_needs_stat(opts) ? LOAD_STAT : 0) |
+               (opts->format == LSV_FORMAT_TEXT ? LOAD_WIDTH : 0) |
+               (lsv_needs_links(opts) ? LOAD_LINKS : 0) |
+               opts->sort << LOAD_SORT_SHIFT | opts->hidden << LOAD_HIDDEN_SHIFT;
+    uint64_t key[2] = { (uint64_t)st.st_dev, (uint64_t)st.st_ino };
+    const struct strmap_slot *slot = strmap_find(&c->map, (const char *)key, sizeof(key));
+    struct cache_entry *e = slot ? slot->value : NULL;
+
+    if (e != NULL && e->in_use)
+        return lsv_dir_load(path, opts);    // e.g. the same tree listed twice
+    if (e != NULL && e->dir != NULL) {
+        if (e->load == load && same_time(&e->mtime, &st.st_mtim) &&
+            same_time(&e->ctime, &st.st_ctim)) {
+            char *p = strdup(path);     // the same directory may be reached by another path
+            if (p != NULL) {
+                free(e->dir->path);
+                e->dir->path = p;
+                e->in_use = 1;
+                return e->dir;
+            }
+        }
+        lsv_dir_free(e->dir);
+        e->dir = NULL;
+    }
+
+    if (e == NULL) {
+        if (c->map.count >= c->max_dirs)
+            cache_clear(c);
+        e = calloc(1, sizeof(*e));
+        if (e == NULL || strmap_put(&c->map, (const char *)key, sizeof(key), e) == NULL) {
+            free(e);
+            return lsv_dir_load(path, opts);
+        }
+        e->wd = -1;
+    }
+
+    // Watch before reading so no change after the read can be missed
+    if (c->inotify_fd != -1)
+        watch(c, e, inotify_add_watch(c->inotify_fd, path, WATCH_MASK));
+    if ((load & LOAD_STAT) && e->wd == -1)
+        return lsv_dir_load(path, opts);
+
+    struct lsv_dir *d = lsv_dir_load(path, opts);
+    if (d == NULL || d->read_errno != 0)
+        return d;
+
+    e->dir = d;
+    e->load = load;
+    e->mtime = st.st_mtim;
+    e->ctime = st.st_ctim;
+    e->in_use = 1;
+    e->stale = 0;
+    d->entry = e;
+    return d;
+}
+
+void cache_put(struct lsv_dir *d)
+{
+    struct cache_entry *e = d->entry;
+
+    if (e == NULL) {
+        lsv_dir_free(d);
+        return;
+    }
+    e->in_use = 0;
+    if (e->orphan) {
+        lsv_dir_free(d);
+        free(e);
+    } else if (e->stale) {
+        lsv_dir_free(d);
+        e->dir = NULL;
+        e->stale = 0;
+    }
+}
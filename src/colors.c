@@ -0,0 +1,351 @@
+/*
+* liblsv: LS_COLORS parsing and lookup
+*
+* LS_COLORS is parsed once into
+*   - a table indexed by file kind (di, ln, ex, pi, ...), and
+*   - a hash table of "*suffix" patterns keyed by the suffix text.
+* Every value is stored as the finished escape sequence (lc + code + rc),
+* with dircolors' backslash and caret escapes decoded, so coloring a name
+* is one kind lookup plus, for regular files, one hash lookup on the
+* name's extension, followed by plain memcpy()s into the output buffer.
+* Suffixes match case-insensitively, as in GNU ls, but patterns differing
+* only in case are not told apart: the last one wins. "no" colors names
+* whose own kind is unset and "rs" is the reset code. "or", "mi" and
+* "ca" are ignored: they would cost a stat() of every symlink's target or
+* a getxattr() of every file, so orphan links are colored as "ln" and
+* files with capabilities by their mode. Without LS_COLORS the original
+* lsv palette is used.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+/* The palette lsv has always used: blue dirs, pink links, green
+   executables, red archives, reverse video for special files */
+static const char default_spec[] =
+    "di=0;34:ln=0;35:ex=0;32:pi=7:so=7:bd=7:cd=7:"
+    "*.tar=0;31:*.gz=0;31:*.zip=0;31";
+
+static const char *const kind_keys[COLOR_KINDS] = {
+    [COLOR_FILE]   = "fi",
+    [COLOR_DIR]    = "di",
+    [COLOR_LINK]   = "ln",
+    [COLOR_FIFO]   = "pi",
+    [COLOR_SOCK]   = "so",
+    [COLOR_BLK]    = "bd",
+    [COLOR_CHR]    = "cd",
+    [COLOR_EXEC]   = "ex",
+    [COLOR_SETUID] = "su",
+    [COLOR_SETGID] = "sg",
+    [COLOR_STICKY] = "st",
+    [COLOR_OTHER_WRITABLE] = "ow",
+    [COLOR_STICKY_OTHER_WRITABLE] = "tw",
+    [COLOR_NORMAL] = "no",
+};
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Decodes the escapes dircolors writes: \a \b \e \f \n \r \t \v, \?
+   (DEL), \_ (space), \NNN octal, \xHH hex and ^X control characters;
+   any other escaped character stands for itself. The result is never
+   longer than the input. */
+static size_t decode_escapes(const char *s, size_t len, char *out)
+{
+    size_t k = 0;
+
+    for (size_t i = 0; i < len; ) {
+        char c = s[i++];
+        if (c == '^' && i < len && (s[i] == '?' || (s[i] >= '@' && s[i] <= '~'))) {
+            out[k++] = s[i] == '?' ? 0x7f : (char)(s[i] & 0x1f);
+            i++;
+            continue;
+        }
+        if (c != '\\' || i == len) {
+            out[k++] = c;
+            continue;
+        }
+
+        c = s[i++];
+        if (c >= '0' && c <= '7') {
+            unsigned v = (unsigned)(c - '0');
+            for (int n = 1; n < 3 && i < len && s[i] >= '0' && s[i] <= '7'; n++)
+                v = v * 8 + (unsigned)(s[i++] - '0');
+            out[k++] = (char)v;
+        } else if ((c == 'x' || c == 'X') && i < len && hex_digit(s[i]) >= 0) {
+            unsigned v = 0;
+            for (int n = 0; n < 2 && i < len && hex_digit(s[i]) >= 0; n++)
+                v = v * 16 + (unsigned)hex_digit(s[i++]);
+            out[k++] = (char)v;
+        } else {
+            switch (c) {
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'e': c = 0x1b; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            case '?': c = 0x7f; break;
+            case '_': c = ' '; break;
+            default:  break;
+            }
+            out[k++] = c;
+        }
+    }
+    return k;
+}
+
+static inline char fold_ascii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c + 'a' - 'A') : c;
+}
+
+static int make_seq(struct color_seq *seq, const char *lc, size_t lc_len,
+                    const char *code, size_t code_len, const char *rc, size_t rc_len)
+{
+    free(seq->seq);
+    seq->len = 0;
+    seq->seq = malloc(lc_len + code_len + rc_len + 1);
+    if (seq->seq == NULL)
+        return -1;
+    seq->len = decode_escapes(lc, lc_len, seq->seq);
+    seq->len += decode_escapes(code, code_len, seq->seq + seq->len);
+    seq->len += decode_escapes(rc, rc_len, seq->seq + seq->len);
+    seq->seq[seq->len] = '\0';
+    return 0;
+}
+
+static void free_seq_value(void *p)
+{
+    struct color_seq *seq = p;
+    if (seq != NULL)
+        free(seq->seq);
+    free(seq);
+}
+
+void lsv_colors_free(struct lsv_colors *c)
+{
+    if (c == NULL)
+        return;
+    for (int i = 0; i < COLOR_KINDS; i++)
+        free(c->kind[i].seq);
+    free(c->reset.seq);
+    strmap_free(&c->ext, free_seq_value);
+    free(c);
+}
+
+/* Finds a field's value (up to ':' or the end) for a two-letter key */
+static const char *find_key(const char *spec, const char *key, size_t *len)
+{
+    for (const char *p = spec; *p; ) {
+        const char *end = strchr(p, ':');
+        if (end == NULL)
+            end = p + strlen(p);
+        if (end - p > 3 && p[0] == key[0] && p[1] == key[1] && p[2] == '=') {
+            *len = (size_t)(end - p - 3);
+            return p + 3;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return NULL;
+}
+
+static void note_suffix_len(struct lsv_colors *c, const char *key, size_t len)
+{
+    // Names are looked up by their last ".ext" first; anything else
+    // (multi-dot or dot-less suffixes) needs a lookup per distinct length
+    const char *dot = memrchr(key, '.', len);
+    if (dot == key)
+        return;
+
+    for (size_t i = 0; i < c->nodd; i++) {
+        if (c->odd_lens[i] == len)
+            return;
+    }
+    if (c->nodd < MAX_ODD_SUFFIX_LENS)
+        c->odd_lens[c->nodd++] = len;
+}
+
+struct lsv_colors *lsv_colors_parse(const char *spec)
+{
+    if (spec == NULL || *spec == '\0')
+        spec = default_spec;
+
+    struct lsv_colors *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return NULL;
+
+    size_t lc_len = 2, rc_len = 1, ec_len = 0, rs_len = 1;
+    const char *lc = find_key(spec, "lc", &lc_len);
+    const char *rc = find_key(spec, "rc", &rc_len);
+    const char *ec = find_key(spec, "ec", &ec_len);
+    const char *rs = find_key(spec, "rs", &rs_len);
+    if (lc == NULL) { lc = "\033["; lc_len = 2; }
+    if (rc == NULL) { rc = "m"; rc_len = 1; }
+    if (rs == NULL) { rs = "0"; rs_len = 1; }
+
+    int rc_ok = ec ? make_seq(&c->reset, ec, ec_len, "", 0, "", 0)
+                   : make_seq(&c->reset, lc, lc_len, rs, rs_len, rc, rc_len);
+    if (rc_ok == -1)
+        goto fail;
+
+    for (const char *p = spec; *p; ) {
+        const char *end = strchr(p, ':');
+        if (end == NULL)
+            end = p + strlen(p);
+        const char *eq = memchr(p, '=', (size_t)(end - p));
+
+        if (eq != NULL && eq + 1 < end) {
+            const char *code = eq + 1;
+            size_t code_len = (size_t)(end - code);
+
+            if (p[0] == '*' && eq - p > 1) {
+                struct color_seq *seq = calloc(1, sizeof(*seq));
+                char *key = malloc((size_t)(eq - p));
+                if (seq == NULL || key == NULL ||
+                    make_seq(seq, lc, lc_len, code, code_len, rc, rc_len) == -1) {
+                    free(key);
+                    free_seq_value(seq);
+                    goto fail;
+                }
+                size_t klen = decode_escapes(p + 1, (size_t)(eq - p - 1), key);
+                for (size_t i = 0; i < klen; i++)
+                    key[i] = fold_ascii(key[i]);
+
+                const struct strmap_slot *old = strmap_find(&c->ext, key, klen);
+                if (old != NULL)
+                    free_seq_value(old->value);
+                if (strmap_put(&c->ext, key, klen, seq) == NULL) {
+                    free(key);
+                    free_seq_value(seq);
+                    goto fail;
+                }
+                note_suffix_len(c, key, klen);
+                free(key);
+            } else if (eq - p == 2) {
+                for (int k = 0; k < COLOR_KINDS; k++) {
+                    if (p[0] == kind_keys[k][0] && p[1] == kind_keys[k][1]) {
+                        if (make_seq(&c->kind[k], lc, lc_len, code, code_len, rc, rc_len) == -1)
+                            goto fail;
+                        break;
+                    }
+                }
+            }
+        }
+        p = *end ? end + 1 : end;
+    }
+    return c;
+
+fail:
+    lsv_colors_free(c);
+    return NULL;
+}
+
+/* Process-wide palette from $LS_COLORS, parsed on first use and again
+   whenever the variable changes (lsvd sets it per request) */
+const struct lsv_colors *lsv_colors_default(void)
+{
+    static struct lsv_colors *colors;
+    static char *spec;      // $LS_COLORS the palette was parsed from
+    const char *env = getenv("LS_COLORS");
+
+    if (colors != NULL && (env ? spec && strcmp(env, spec) == 0 : spec == NULL))
+        return colors;
+
+    struct lsv_colors *fresh = lsv_colors_parse(env);
+    char *fresh_spec = env ? strdup(env) : NULL;
+    if (fresh == NULL || (env && fresh_spec == NULL)) {
+        lsv_colors_free(fresh);
+        free(fresh_spec);
+        return colors;
+    }
+    lsv_colors_free(colors);
+    free(spec);
+    colors = fresh;
+    spec = fresh_spec;
+    return colors;
+}
+
+static const struct color_seq *usable(const struct color_seq *seq)
+{
+    return seq->len > 0 ? seq : NULL;
+}
+
+/* A kind's own sequence, else "no" */
+static const struct color_seq *kind_seq(const struct lsv_colors *c, enum color_kind k)
+{
+    const struct color_seq *seq = usable(&c->kind[k]);
+    return seq ? seq : usable(&c->kind[COLOR_NORMAL]);
+}
+
+/* Looks a name's trailing n bytes up in the case-folded suffix table */
+static const struct strmap_slot *find_suffix(const struct lsv_colors *c, const char *s, size_t n)
+{
+    char folded[NAME_MAX + 1];
+
+    if (n > sizeof(folded))
+        return NULL;
+    for (size_t i = 0; i < n; i++)
+        folded[i] = fold_ascii(s[i]);
+    return strmap_find(&c->ext, folded, n);
+}
+
+/* Returns the escape sequence for a name, or NULL for uncolored output */
+const struct color_seq *colors_lookup(const struct lsv_colors *c, const char *name,
+                                      size_t len, mode_t mode)
+{
+    const struct color_seq *seq;
+
+    switch (mode & S_IFMT) {
+    case S_IFDIR:
+        if ((mode & S_ISVTX) && (mode & S_IWOTH) && (seq = usable(&c->kind[COLOR_STICKY_OTHER_WRITABLE])))
+            return seq;
+        if ((mode & S_IWOTH) && (seq = usable(&c->kind[COLOR_OTHER_WRITABLE])))
+            return seq;
+        if ((mode & S_ISVTX) && (seq = usable(&c->kind[COLOR_STICKY])))
+            return seq;
+        return kind_seq(c, COLOR_DIR);
+    case S_IFLNK:  return kind_seq(c, COLOR_LINK);
+    case S_IFIFO:  return kind_seq(c, COLOR_FIFO);
+    case S_IFSOCK: return kind_seq(c, COLOR_SOCK);
+    case S_IFBLK:  return kind_seq(c, COLOR_BLK);
+    case S_IFCHR:  return kind_seq(c, COLOR_CHR);
+    default:
+        break;
+    }
+
+    if ((mode & S_ISUID) && (seq = usable(&c->kind[COLOR_SETUID])))
+        return seq;
+    if ((mode & S_ISGID) && (seq = usable(&c->kind[COLOR_SETGID])))
+        return seq;
+    if ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) && (seq = usable(&c->kind[COLOR_EXEC])))
+        return seq;
+
+    if (c->ext.count > 0) {
+        const char *dot = memrchr(name, '.', len);
+        const struct strmap_slot *hit = NULL;
+        if (dot != NULL && dot != name)
+            hit = find_suffix(c, dot, len - (size_t)(dot - name));
+        for (size_t i = 0; hit == NULL && i < c->nodd; i++) {
+            size_t n = c->odd_lens[i];
+            if (n <= len)
+                hit = find_suffix(c, name + len - n, n);
+        }
+        if (hit != NULL)
+            return hit->value;
+    }
+    return kind_seq(c, COLOR_FILE);
+}
@@ -0,0 +1,207 @@
+/*
+* liblsv: count-only walk (--count)
+*
+* Reads directories with raw getdents64() into a reusable buffer and
+* looks only at d_name and d_type: nothing is copied, sorted or stat'ed.
+* Subdirectories are opened with openat() relative to their parent while
+* the parent's buffer is still being scanned, so the only per-directory
+* state is one fd and one buffer per level of depth. fstatat() is used
+* solely for file systems that report DT_UNKNOWN.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "lsv_int.h"
+
+#define DENTS_BUF_SIZE (64 * 1024)
+
+struct linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+struct counter {
+    const struct lsv_options  *opts;
+    const struct lsv_walk_ops *ops;
+    void                      *ctx;
+    struct lsv_out            *out;
+    char  **bufs;       // one getdents buffer per depth, reused across siblings
+    size_t  nbufs;
+    char   *path;       // path of the directory being read
+    size_t  path_len;
+    size_t  path_cap;
+    uint64_t total;
+    int      hidden;    // enum lsv_hidden; "." and ".." are never counted
+};
+
+static char *depth_buffer(struct counter *c, size_t depth)
+{
+    if (depth >= c->nbufs) {
+        char **bufs = realloc(c->bufs, (depth + 1) * sizeof(*bufs));
+        if (bufs == NULL)
+            return NULL;
+        for (size_t i = c->nbufs; i <= depth; i++)
+            bufs[i] = NULL;
+        c->bufs = bufs;
+        c->nbufs = depth + 1;
+    }
+    if (c->bufs[depth] == NULL)
+        c->bufs[depth] = malloc(DENTS_BUF_SIZE);
+    return c->bufs[depth];
+}
+
+static int path_push(struct counter *c, const char *name)
+{
+    size_t nlen = strlen(name);
+    size_t need = c->path_len + 1 + nlen + 1;
+    if (need > c->path_cap) {
+        size_t cap = c->path_cap ? c->path_cap : 256;
+        while (cap < need)
+            cap *= 2;
+        char *p = realloc(c->path, cap);
+        if (p == NULL)
+            return -1;
+        c->path = p;
+        c->path_cap = cap;
+    }
+    c->path[c->path_len] = '/';
+    memcpy(c->path + c->path_len + 1, name, nlen + 1);
+    c->path_len += 1 + nlen;
+    return 0;
+}
+
+static void report(struct counter *c, const char *what, int err)
+{
+    if (c->ops && c->ops->error)
+        c->ops->error(c->path, what, err, c->ctx);
+}
+
+static int is_dir_entry(int dirfd, const struct linux_dirent64 *d)
+{
+    if (d->d_type != DT_UNKNOWN)
+        return d->d_type == DT_DIR;
+
+    struct stat st;
+    return fstatat(dirfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Records in a getdents64() buffer, for the throttle's latency per entry */
+static size_t dirents_in(const char *buf, long got)
+{
+    size_t n = 0;
+    for (long off = 0; off < got; off += ((const struct linux_dirent64 *)(buf + off))->d_reclen)
+        n++;
+    return n;
+}
+
+/* Counts the entries of the open directory fd (closed on return) */
+static void count_dir(struct counter *c, int fd, size_t depth)
+{
+    char *buf = depth_buffer(c, depth);
+    uint64_t n = 0;
+    struct lsv_throttle *throttle = c->opts->throttle;
+    size_t first = 1;   // the directory is charged to its first read
+
+    if (buf == NULL) {
+        report(c, "readdir", ENOMEM);
+        close(fd);
+        return;
+    }
+
+    for (;;) {
+        uint64_t started = throttle ? throttle_begin(throttle, THROTTLE_DIR, first) : 0;
+        long got = syscall(SYS_getdents64, fd, buf, DENTS_BUF_SIZE);
+        if (throttle != NULL) {
+            int saved = errno;
+            throttle_end(throttle, THROTTLE_DIR, first, got > 0 ? dirents_in(buf, got) : 0, started);
+            errno = saved;
+        }
+        first = 0;
+        if (got == -1) {
+            if (errno == EINTR)
+                continue;
+            report(c, "readdir", errno);
+            break;
+        }
+        if (got == 0)
+            break;
+
+        for (long off = 0; off < got; ) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            if (hidden_skip(d->d_name, c->hidden))
+                continue;
+
+            int verdict = FILTER_KEEP;
+            if (c->opts->filter != NULL) {
+                verdict = filter_check(c->opts->filter, fd, d->d_name, d->d_type);
+                if (verdict == FILTER_DROP)
+                    continue;
+            }
+            n++;
+
+            if (!c->opts->recursive || verdict == FILTER_PRUNE || !is_dir_entry(fd, d))
+                continue;
+
+            size_t saved_len = c->path_len;
+            if (path_push(c, d->d_name) == -1)
+                continue;
+            int child = openat(fd, d->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child == -1)
+                report(c, "opendir", errno);
+            else
+                count_dir(c, child, depth + 1);
+            c->path_len = saved_len;
+            c->path[saved_len] = '\0';
+        }
+    }
+    close(fd);
+
+    c->total += n;
+    lsv_out_u64(c->out, n);
+    lsv_out_putc(c->out, '\t');
+    lsv_out_write(c->out, c->path, c->path_len);
+    lsv_out_putc(c->out, '\n');
+}
+
+/* Prints "count<TAB>path" per directory (post-order) and returns the
+   number of entries seen below root, root's own entries included */
+uint64_t lsv_count(const char *root, const struct lsv_options *opts,
+                   const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out)
+{
+    struct counter c = { .opts = opts, .ops = ops, .ctx = ctx, .out = out };
+
+    c.hidden = opts->hidden == LSV_HIDDEN_ALL ? LSV_HIDDEN_ALMOST : opts->hidden;
+
+    c.path_len = strlen(root);
+    c.path_cap = c.path_len + 256;
+    c.path = malloc(c.path_cap);
+    if (c.path == NULL)
+        return 0;
+    memcpy(c.path, root, c.path_len + 1);
+
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        report(&c, "opendir", errno);
+    else
+        count_dir(&c, fd, 0);
+
+    for (size_t i = 0; i < c.nbufs; i++)
+        free(c.bufs[i]);
+    free(c.bufs);
+    free(c.path);
+    return c.total;
+}
@@ -0,0 +1,385 @@
+/*
+* liblsv: lsvd request protocol over a Unix socket
+*
+* A client connects and sends one request:
+*   struct lsvd_header { magic, len }
+*   len bytes of NUL-terminated strings: "NAME=value" for each of
+*   LS_COLORS, LC_ALL, LC_COLLATE and LANG that is set, an empty string,
+*   then argv[0..argc-1]
+* together with three descriptors passed as SCM_RIGHTS: its working
+* directory, stdout and stderr. The daemon writes the listing straight to
+* the client's stdout, so results stream without being relayed through
+* the socket, and answers with the int32 exit status.
+*
+* Only clients running as the daemon's own user are served, one request
+* at a time: the request runs in the daemon's own process with the
+* client's cwd, descriptors and variables swapped in.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "lsv_int.h"
+
+#define LSVD_MAGIC       0x3256534cu    // "LSV2"
+#define LSVD_MAX_REQUEST (1024 * 1024)
+#define LSVD_NFDS        3
+
+struct lsvd_header {
+    uint32_t magic;
+    uint32_t len;
+};
+
+/* The client variables a request runs with: the palette, and what
+   setlocale(LC_COLLATE, "") reads for --collate */
+static const char *const forwarded[] = { "LS_COLORS", "LC_ALL", "LC_COLLATE", "LANG" };
+#define NFORWARDED (sizeof(forwarded) / sizeof(forwarded[0]))
+
+static const char **request_var(struct lsv_request *req, size_t i)
+{
+    const char **vars[NFORWARDED] = { &req->ls_colors, &req->lc_all, &req->lc_collate, &req->lang };
+    return vars[i];
+}
+
+int lsv_daemon_path(char *buf, size_t size)
+{
+    const char *env = getenv("LSVD_SOCKET");
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    int n;
+
+    if (env != NULL && *env != '\0')
+        n = snprintf(buf, size, "%s", env);
+    else if (run != NULL && *run != '\0')
+        n = snprintf(buf, size, "%s/lsvd.sock", run);
+    else
+        n = snprintf(buf, size, "/tmp/lsvd-%u.sock", (unsigned)geteuid());
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static int socket_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int read_full(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            if (r == 0)
+                errno = ECONNRESET;
+            return -1;
+        }
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+/* ===============================================
+   Server Side
+   =============================================== */
+/* Removes a socket left behind by a daemon that is gone. A live daemon's
+   socket (it still accepts) and anything that is not a socket stay. */
+static int remove_stale(const char *path, const struct sockaddr_un *addr)
+{
+    struct stat st;
+    if (lstat(path, &st) == -1)
+        return errno == ENOENT ? 0 : -1;
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    int rc = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+    int refused = rc == -1 && errno == ECONNREFUSED;
+    close(fd);
+    if (!refused) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+    return unlink(path);
+}
+
+int lsv_daemon_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    if (socket_addr(&addr, path) == -1)
+        return -1;
+
+    if (remove_stale(path, &addr) == -1)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    mode_t old = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old);
+    if (rc == -1 || listen(fd, 64) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static void close_fds(struct lsv_request *req)
+{
+    if (req->cwd != -1) close(req->cwd);
+    if (req->out != -1) close(req->out);
+    if (req->err != -1) close(req->err);
+    req->cwd = req->out = req->err = -1;
+}
+
+static int receive(struct lsv_request *req)
+{
+    struct ucred cred;
+    socklen_t clen = sizeof(cred);
+    if (getsockopt(req->conn, SOL_SOCKET, SO_PEERCRED, &cred, &clen) == -1)
+        return -1;
+    if (cred.uid != geteuid()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    // A stalled client must not hold up everyone else
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(req->conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct lsvd_header h;
+    union {
+        char           buf[CMSG_SPACE(LSVD_NFDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { &h, sizeof(h) };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+    };
+
+    ssize_t n;
+    do {
+        n = recvmsg(req->conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1)
+        return -1;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm != NULL && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS &&
+        cm->cmsg_len == CMSG_LEN(LSVD_NFDS * sizeof(int))) {
+        int fds[LSVD_NFDS];
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+        req->cwd = fds[0];
+        req->out = fds[1];
+        req->err = fds[2];
+    }
+    if (req->cwd == -1 || (msg.msg_flags & MSG_CTRUNC)) {
+        errno = EPROTO;
+        return -1;
+    }
+    if ((size_t)n < sizeof(h) && read_full(req->conn, (char *)&h + n, sizeof(h) - (size_t)n) == -1)
+        return -1;
+    if (h.magic != LSVD_MAGIC || h.len == 0 || h.len > LSVD_MAX_REQUEST) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    req->buf = malloc(h.len + 1);
+    if (req->buf == NULL || read_full(req->conn, req->buf, h.len) == -1)
+        return -1;
+    req->buf[h.len] = '\0';
+
+    // Split into the variables, up to the empty string, and argv
+    size_t nstr = 0;
+    for (size_t i = 0; i < h.len; i++)
+        nstr += req->buf[i] == '\0';
+    if (req->buf[h.len - 1] != '\0' || nstr < 2) {
+        errno = EPROTO;
+        return -1;
+    }
+    req->argv = calloc(nstr, sizeof(*req->argv));
+    if (req->argv == NULL)
+        return -1;
+
+    char *p = req->buf;
+    for (; p < req->buf + h.len && *p != '\0'; p += strlen(p) + 1) {
+        for (size_t k = 0; k < NFORWARDED; k++) {
+            size_t n = strlen(forwarded[k]);
+            if (strncmp(p, forwarded[k], n) == 0 && p[n] == '=')
+                *request_var(req, k) = p + n + 1;
+        }
+    }
+    p++;    // the empty string
+    if (p >= req->buf + h.len) {
+        errno = EPROTO;
+        return -1;
+    }
+    while (p < req->buf + h.len) {
+        req->argv[req->argc++] = p;
+        p += strlen(p) + 1;
+    }
+    return 0;
+}
+
+/* Waits for the next well-formed request. Returns -1 only when the
+   listening socket itself fails; bad clients are dropped silently. */
+int lsv_daemon_accept(int listen_fd, struct lsv_request *req)
+{
+    for (;;) {
+        memset(req, 0, sizeof(*req));
+        req->cwd = req->out = req->err = -1;
+
+        req->conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (req->conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE ||
+                errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                continue;
+            return -1;
+        }
+        if (receive(req) == 0)
+            return 0;
+
+        close_fds(req);
+        close(req->conn);
+        free(req->argv);
+        free(req->buf);
+    }
+}
+
+void lsv_daemon_reply(struct lsv_request *req, int status)
+{
+    int32_t st = status;
+
+    close_fds(req);     // the client sees EOF on its stdout first
+    if (write(req->conn, &st, sizeof(st)) != (ssize_t)sizeof(st)) {
+        // The client went away; nothing left to tell it
+    }
+    close(req->conn);
+    free(req->argv);
+    free(req->buf);
+}
+
+/* ===============================================
+   Client Side
+   =============================================== */
+int lsv_daemon_call(const char *path, int argc, char *const argv[])
+{
+    struct sockaddr_un addr;
+    if (socket_addr(&addr, path) == -1)
+        return -1;
+
+    const char *vars[NFORWARDED];
+    size_t len = 1;
+    for (size_t k = 0; k < NFORWARDED; k++) {
+        vars[k] = getenv(forwarded[k]);
+        if (vars[k] != NULL)
+            len += strlen(forwarded[k]) + 1 + strlen(vars[k]) + 1;
+    }
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    if (len > LSVD_MAX_REQUEST) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    struct lsvd_header h = { LSVD_MAGIC, (uint32_t)len };
+    char *payload = malloc(len);
+    if (payload == NULL)
+        return -1;
+    char *p = payload;
+    for (size_t k = 0; k < NFORWARDED; k++) {
+        if (vars[k] != NULL)
+            p += sprintf(p, "%s=%s", forwarded[k], vars[k]) + 1;
+    }
+    *p++ = '\0';
+    for (int i = 0; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], n);
+        p += n;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int status = -1;
+    if (fd == -1 || cwd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        goto out;
+
+    int fds[LSVD_NFDS] = { cwd, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char           buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov[2] = { { &h, sizeof(h) }, { payload, len } };
+    struct msghdr msg = {
+        .msg_iov = iov, .msg_iovlen = 2,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1)
+        goto out;
+    // Only the first bytes carry the descriptors; send the rest plainly
+    size_t total = sizeof(h) + len;
+    for (size_t sent = (size_t)n; sent < total; sent += (size_t)n) {
+        const char *src = sent < sizeof(h) ? (const char *)&h + sent : payload + (sent - sizeof(h));
+        size_t chunk = sent < sizeof(h) ? sizeof(h) - sent : total - sent;
+        n = send(fd, src, chunk, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR)
+            n = 0;
+        else if (n == -1)
+            goto out;
+    }
+
+    int32_t st;
+    if (read_full(fd, &st, sizeof(st)) == 0)
+        status = st;
+
+out:
+    {
+        int saved = errno;
+        if (fd != -1)
+            close(fd);
+        if (cwd != -1)
+            close(cwd);
+        free(payload);
+        errno = saved;
+    }
+    return status;
+}
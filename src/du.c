@@ -0,0 +1,204 @@
+/*
+* liblsv: disk-usage aggregation (-s / --du)
+*
+* Sums st_blocks, st_size and entry counts bottom-up while the walker
+* runs: lsv_du_visit() adds a directory's own entries when it is entered
+* and lsv_du_leave() folds the finished subtree into its parent, so no
+* per-entry data outlives its directory. Files with more than one link
+* are counted once per (st_dev, st_ino).
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+struct du_frame {
+    struct lsv_du_totals t;
+};
+
+struct inode_set {
+    uint64_t *keys;     // pairs of (dev, ino); dev == 0 && ino == 0 is empty
+    size_t    cap;      // number of pairs, power of two
+    size_t    count;
+};
+
+struct lsv_du {
+    struct du_frame *frames;    // one per depth of the current path
+    size_t           nframes;
+    struct inode_set seen;
+    struct topn      top;       // only used when a top-N bound was given
+};
+
+/* ===============================================
+   Hard-Link Set
+   =============================================== */
+static uint64_t hash_inode(uint64_t dev, uint64_t ino)
+{
+    uint64_t h = ino * 0x9e3779b97f4a7c15ULL ^ dev;
+    h ^= h >> 31;
+    return h * 0xbf58476d1ce4e5b9ULL;
+}
+
+static int set_grow(struct inode_set *s)
+{
+    size_t cap = s->cap ? s->cap * 2 : 1024;
+    uint64_t *keys = calloc(cap * 2, sizeof(*keys));
+    if (keys == NULL)
+        return -1;
+
+    for (size_t i = 0; i < s->cap; i++) {
+        uint64_t dev = s->keys[2 * i], ino = s->keys[2 * i + 1];
+        if (dev == 0 && ino == 0)
+            continue;
+        size_t j = hash_inode(dev, ino) & (cap - 1);
+        while (keys[2 * j] != 0 || keys[2 * j + 1] != 0)
+            j = (j + 1) & (cap - 1);
+        keys[2 * j] = dev;
+        keys[2 * j + 1] = ino;
+    }
+    free(s->keys);
+    s->keys = keys;
+    s->cap = cap;
+    return 0;
+}
+
+/* Returns 1 if (dev, ino) was newly added, 0 if it was already present */
+static int set_insert(struct inode_set *s, uint64_t dev, uint64_t ino)
+{
+    if ((s->count + 1) * 4 > s->cap * 3 && set_grow(s) == -1)
+        return 1;   // out of memory: count it rather than drop it
+
+    size_t i = hash_inode(dev, ino) & (s->cap - 1);
+    while (s->keys[2 * i] != 0 || s->keys[2 * i + 1] != 0) {
+        if (s->keys[2 * i] == dev && s->keys[2 * i + 1] == ino)
+            return 0;
+        i = (i + 1) & (s->cap - 1);
+    }
+    s->keys[2 * i] = dev;
+    s->keys[2 * i + 1] = ino;
+    s->count++;
+    return 1;
+}
+
+/* ===============================================
+   Aggregation
+   =============================================== */
+struct lsv_du *lsv_du_new(size_t top)
+{
+    struct lsv_du *du = calloc(1, sizeof(*du));
+    if (du == NULL)
+        return NULL;
+    if (topn_init(&du->top, top) == -1) {
+        free(du);
+        return NULL;
+    }
+    return du;
+}
+
+void lsv_du_free(struct lsv_du *du)
+{
+    if (du == NULL)
+        return;
+    free(du->frames);
+    free(du->seen.keys);
+    topn_free(&du->top);
+    free(du);
+}
+
+static void add_stat(struct lsv_du *du, struct lsv_du_totals *t, const struct stat *st)
+{
+    if (!S_ISDIR(st->st_mode) && st->st_nlink > 1 &&
+        !set_insert(&du->seen, (uint64_t)st->st_dev, (uint64_t)st->st_ino))
+        return;
+    t->blocks += (uint64_t)st->st_blocks;
+    t->bytes += (uint64_t)st->st_size;
+}
+
+int lsv_du_visit(struct lsv_du *du, const struct lsv_dir *dir, int depth)
+{
+    size_t need = (size_t)depth + 1;
+    if (need > du->nframes) {
+        struct du_frame *frames = realloc(du->frames, need * sizeof(*frames));
+        if (frames == NULL)
+            return -1;
+        du->frames = frames;
+        du->nframes = need;
+    }
+
+    struct lsv_du_totals *t = &du->frames[depth].t;
+    memset(t, 0, sizeof(*t));
+
+    // A directory's own blocks belong to it, not to its parent
+    if (dir->has_self)
+        add_stat(du, t, &dir->self);
+
+    // Non-directory entries live on the directory's own device
+    uint64_t dev = dir->has_self ? (uint64_t)dir->self.st_dev : 0;
+    for (size_t i = 0; i < dir->count; i++) {
+        // -a: "." and ".." are this directory and its parent. The name
+        // decides, since mode[] is garbage where lstat() failed.
+        if (is_dot_or_dotdot(dir_name(dir, i)))
+            continue;
+        t->entries++;
+        if (!dir_has_stat(dir, i) || S_ISDIR(dir->mode[i]))
+            continue;
+        if (dir->nlink[i] > 1 && !set_insert(&du->seen, dev, dir->ino[i]))
+            continue;
+        t->blocks += (uint64_t)dir->blocks[i];
+        t->bytes += (uint64_t)dir->size[i];
+    }
+    return 0;
+}
+
+static void put_totals(struct lsv_out *out, const struct lsv_du_totals *t, const char *path)
+{
+    lsv_out_u64(out, (t->blocks * 512 + 1023) / 1024);
+    lsv_out_putc(out, '\t');
+    lsv_out_u64(out, t->bytes);
+    lsv_out_putc(out, '\t');
+    lsv_out_u64(out, t->entries);
+    lsv_out_putc(out, '\t');
+    lsv_out_puts(out, path);
+    lsv_out_putc(out, '\n');
+}
+
+void lsv_du_leave(struct lsv_du *du, const struct lsv_dir *dir, int depth,
+                  struct lsv_du_totals *total, struct lsv_out *out)
+{
+    if ((size_t)depth >= du->nframes)
+        return;     // lsv_du_visit() failed for this directory
+
+    const struct lsv_du_totals *t = &du->frames[depth].t;
+
+    if (depth > 0) {
+        struct lsv_du_totals *parent = &du->frames[depth - 1].t;
+        parent->blocks += t->blocks;
+        parent->bytes += t->bytes;
+        parent->entries += t->entries;
+    } else if (total != NULL) {
+        *total = *t;
+    }
+
+    if (du->top.cap > 0) {
+        uint64_t val[TOPN_VALS] = { t->bytes, t->entries, 0 };
+        topn_offer(&du->top, t->blocks, val, dir->path, strlen(dir->path));
+    } else if (out != NULL) {
+        put_totals(out, t, dir->path);
+    }
+}
+
+/* Prints the retained top-N directories, largest first */
+void lsv_du_finish(struct lsv_du *du, struct lsv_out *out)
+{
+    topn_sort(&du->top);
+    for (size_t i = 0; i < du->top.count; i++) {
+        const struct topn_item *it = &du->top.items[i];
+        struct lsv_du_totals t = { it->key, it->val[0], it->val[1] };
+        put_totals(out, &t, it->label);
+    }
+    topn_free(&du->top);
+}
@@ -0,0 +1,253 @@
+/*
+* liblsv: include / exclude / prune name filters
+*
+* Patterns are shell globs, or POSIX extended regexes when prefixed with
+* "re:". Each set is compiled once into the cheapest form that fits:
+*   - literal names (".git", "node_modules")  -> one hash lookup
+*   - "*suffix" / "prefix*" globs ("*.o")     -> one hash lookup per
+*                                                distinct affix length
+*   - remaining globs                         -> fnmatch()
+*   - all regexes of a set                    -> one combined "(a)|(b)"
+*                                                automaton, one regexec()
+* filter_check() runs on the bare d_name straight out of readdir(), before
+* any stat(), so excluded and pruned directories are never opened.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+#define MAX_AFFIX_LENS 32
+
+struct affix_set {
+    struct strmap map;
+    size_t        lens[MAX_AFFIX_LENS];     // distinct key lengths present
+    size_t        nlens;
+};
+
+struct matcher {
+    size_t           npatterns;
+    struct strmap    exact;
+    struct affix_set suffix;
+    struct affix_set prefix;
+    char           **globs;
+    size_t           nglobs;
+    char           **regexes;       // sources, combined by lsv_filter_compile()
+    size_t           nregexes;
+    regex_t          re;
+    int              has_re;
+};
+
+struct lsv_filter {
+    struct matcher sets[3];     // indexed by enum lsv_filter_kind
+};
+
+struct lsv_filter *lsv_filter_new(void)
+{
+    return calloc(1, sizeof(struct lsv_filter));
+}
+
+static void matcher_free(struct matcher *m)
+{
+    strmap_free(&m->exact, NULL);
+    strmap_free(&m->suffix.map, NULL);
+    strmap_free(&m->prefix.map, NULL);
+    for (size_t i = 0; i < m->nglobs; i++)
+        free(m->globs[i]);
+    free(m->globs);
+    for (size_t i = 0; i < m->nregexes; i++)
+        free(m->regexes[i]);
+    free(m->regexes);
+    if (m->has_re)
+        regfree(&m->re);
+}
+
+void lsv_filter_free(struct lsv_filter *f)
+{
+    if (f == NULL)
+        return;
+    for (int i = 0; i < 3; i++)
+        matcher_free(&f->sets[i]);
+    free(f);
+}
+
+/* ===============================================
+   Pattern Classification
+   =============================================== */
+static int has_glob_meta(const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\')
+            return 1;
+    }
+    return 0;
+}
+
+static int append_str(char ***list, size_t *n, const char *s)
+{
+    char **grown = realloc(*list, (*n + 1) * sizeof(**list));
+    if (grown == NULL)
+        return -1;
+    *list = grown;
+    if ((grown[*n] = strdup(s)) == NULL)
+        return -1;
+    (*n)++;
+    return 0;
+}
+
+static int affix_add(struct affix_set *a, const char *key, size_t len)
+{
+    size_t i;
+    for (i = 0; i < a->nlens && a->lens[i] != len; i++)
+        ;
+    if (i == a->nlens) {
+        if (a->nlens == MAX_AFFIX_LENS)
+            return 1;   // too many shapes: caller falls back to fnmatch()
+        a->lens[a->nlens++] = len;
+    }
+    return strmap_put(&a->map, key, len, NULL) ? 0 : -1;
+}
+
+int lsv_filter_add(struct lsv_filter *f, int kind, const char *pattern)
+{
+    if (kind < LSV_FILTER_INCLUDE || kind > LSV_FILTER_PRUNE || pattern[0] == '\0') {
+        errno = EINVAL;
+        return -1;
+    }
+    struct matcher *m = &f->sets[kind];
+
+    if (strncmp(pattern, "re:", 3) == 0) {
+        // Validate now so the caller can report the offending pattern
+        regex_t re;
+        if (regcomp(&re, pattern + 3, REG_EXTENDED | REG_NOSUB) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        regfree(&re);
+        if (append_str(&m->regexes, &m->nregexes, pattern + 3) == -1)
+            return -1;
+        m->npatterns++;
+        return 0;
+    }
+
+    size_t len = strlen(pattern);
+    int rc = 1;
+    if (!has_glob_meta(pattern, len))
+        rc = strmap_put(&m->exact, pattern, len, NULL) ? 0 : -1;
+    else if (len > 1 && pattern[0] == '*' && !has_glob_meta(pattern + 1, len - 1))
+        rc = affix_add(&m->suffix, pattern + 1, len - 1);
+    else if (len > 1 && pattern[len - 1] == '*' && !has_glob_meta(pattern, len - 1))
+        rc = affix_add(&m->prefix, pattern, len - 1);
+
+    if (rc == 1)
+        rc = append_str(&m->globs, &m->nglobs, pattern);
+    if (rc == -1)
+        return -1;
+    m->npatterns++;
+    return 0;
+}
+
+/* Builds the combined regex of every set; call after the last add */
+int lsv_filter_compile(struct lsv_filter *f)
+{
+    for (int k = 0; k < 3; k++) {
+        struct matcher *m = &f->sets[k];
+        if (m->has_re) {
+            regfree(&m->re);
+            m->has_re = 0;
+        }
+        if (m->nregexes == 0)
+            continue;
+
+        size_t len = 1;
+        for (size_t i = 0; i < m->nregexes; i++)
+            len += strlen(m->regexes[i]) + 3;
+        char *src = malloc(len);
+        if (src == NULL)
+            return -1;
+
+        char *p = src;
+        for (size_t i = 0; i < m->nregexes; i++) {
+            if (i > 0)
+                *p++ = '|';
+            *p++ = '(';
+            size_t n = strlen(m->regexes[i]);
+            memcpy(p, m->regexes[i], n);
+            p += n;
+            *p++ = ')';
+        }
+        *p = '\0';
+
+        int rc = regcomp(&m->re, src, REG_EXTENDED | REG_NOSUB);
+        free(src);
+        if (rc != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        m->has_re = 1;
+    }
+    return 0;
+}
+
+/* ===============================================
+   Matching
+   =============================================== */
+static int matcher_match(const struct matcher *m, const char *name, size_t len)
+{
+    if (m->npatterns == 0)
+        return 0;
+
+    if (strmap_find(&m->exact, name, len))
+        return 1;
+    for (size_t i = 0; i < m->suffix.nlens; i++) {
+        size_t n = m->suffix.lens[i];
+        if (n <= len && strmap_find(&m->suffix.map, name + len - n, n))
+            return 1;
+    }
+    for (size_t i = 0; i < m->prefix.nlens; i++) {
+        size_t n = m->prefix.lens[i];
+        if (n <= len && strmap_find(&m->prefix.map, name, n))
+            return 1;
+    }
+    for (size_t i = 0; i < m->nglobs; i++) {
+        if (fnmatch(m->globs[i], name, 0) == 0)
+            return 1;
+    }
+    return m->has_re && regexec(&m->re, name, 0, NULL, 0) == 0;
+}
+
+static int entry_is_dir(int dirfd, const char *name, unsigned char type)
+{
+    if (type != DT_UNKNOWN)
+        return type == DT_DIR;
+
+    struct stat st;
+    return fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Exclude wins over prune, prune over include. Include patterns only
+   restrict non-directories, so matches deeper in the tree are found. */
+int filter_check(const struct lsv_filter *f, int dirfd, const char *name, unsigned char type)
+{
+    size_t len = strlen(name);
+
+    if (matcher_match(&f->sets[LSV_FILTER_EXCLUDE], name, len))
+        return FILTER_DROP;
+    if (matcher_match(&f->sets[LSV_FILTER_PRUNE], name, len))
+        return FILTER_PRUNE;
+
+    const struct matcher *inc = &f->sets[LSV_FILTER_INCLUDE];
+    if (inc->npatterns > 0 && !matcher_match(inc, name, len) &&
+        !entry_is_dir(dirfd, name, type))
+        return FILTER_DROP;
+    return FILTER_KEEP;
+}
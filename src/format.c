@@ -0,0 +1,208 @@
+/*
+* liblsv: machine-readable output formats
+*
+* --format=nul    directory/name\0 per entry
+* --format=jsonl  {"path":...,"type":...,"mode":...,...}\n per entry
+* --format=binary fixed-layout struct lsv_bin_record per entry (see lsv.h)
+*
+* JSON strings must be UTF-8, file names need not be. When a record's
+* path is not valid UTF-8, its "path" and "name" carry one character per
+* byte (bytes >= 0x80 written as \u0080..\u00ff) and the record has
+* "bytes":true, so a consumer gets the exact name back by encoding the
+* strings as Latin-1. Entries whose lstat() failed are still written:
+* JSON records with "error":"stat", binary ones with zeroed stat fields,
+* LSV_BIN_NO_STAT and the errno.
+*
+* These never look at the terminal and never colorize; everything is
+* appended straight to the buffered writer.
+*/
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+static void put_path(struct lsv_out *out, const struct lsv_dir *dir, size_t i)
+{
+    lsv_out_puts(out, dir->path);
+    lsv_out_putc(out, '/');
+    lsv_out_write(out, dir_name(dir, i), dir->name_len[i]);
+}
+
+static const char *type_name(mode_t mode)
+{
+    if (S_ISREG(mode)) return "file";
+    if (S_ISDIR(mode)) return "dir";
+    if (S_ISLNK(mode)) return "link";
+    if (S_ISCHR(mode)) return "char";
+    if (S_ISBLK(mode)) return "block";
+    if (S_ISFIFO(mode)) return "fifo";
+    if (S_ISSOCK(mode)) return "socket";
+    return "unknown";
+}
+
+/* ===============================================
+   JSON Lines
+   =============================================== */
+/* Strict UTF-8: no overlong forms, surrogates or code points past U+10FFFF */
+static int utf8_valid(const char *str, size_t n)
+{
+    const unsigned char *s = (const unsigned char *)str;
+
+    for (size_t i = 0; i < n; ) {
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t len;
+        unsigned char lo = 0x80, hi = 0xbf;     // range of the second byte
+        if (c >= 0xc2 && c <= 0xdf) {
+            len = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            len = 3;
+            if (c == 0xe0) lo = 0xa0;
+            if (c == 0xed) hi = 0x9f;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            len = 4;
+            if (c == 0xf0) lo = 0x90;
+            if (c == 0xf4) hi = 0x8f;
+        } else {
+            return 0;
+        }
+        if (n - i < len || s[i + 1] < lo || s[i + 1] > hi)
+            return 0;
+        for (size_t k = 2; k < len; k++) {
+            if ((s[i + k] & 0xc0) != 0x80)
+                return 0;
+        }
+        i += len;
+    }
+    return 1;
+}
+
+/* Escapes quotes, backslashes and control bytes, and with bytes set every
+   byte >= 0x80 as well; other bytes pass through */
+static void put_json_chars(struct lsv_out *out, const char *s, size_t n, int bytes)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;     // start of the pending unescaped run
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && (c < 0x80 || !bytes))
+            continue;
+
+        lsv_out_write(out, s + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            lsv_out_putc(out, '\\');
+            lsv_out_putc(out, (char)c);
+        } else {
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            lsv_out_write(out, esc, sizeof(esc));
+        }
+    }
+    lsv_out_write(out, s + run, n - run);
+}
+
+void render_jsonl(const struct lsv_dir *dir, const struct lsv_options *opts,
+                  struct lsv_out *out)
+{
+    (void)opts;
+    size_t dlen = strlen(dir->path);
+    int dir_utf8 = utf8_valid(dir->path, dlen);
+
+    for (size_t i = 0; i < dir->count; i++) {
+        const char *name = dir_name(dir, i);
+        int bytes = !dir_utf8 || !utf8_valid(name, dir->name_len[i]);
+
+        lsv_out_puts(out, "{\"path\":\"");
+        put_json_chars(out, dir->path, dlen, bytes);
+        lsv_out_putc(out, '/');
+        put_json_chars(out, name, dir->name_len[i], bytes);
+        lsv_out_puts(out, "\",\"name\":\"");
+        put_json_chars(out, name, dir->name_len[i], bytes);
+        lsv_out_putc(out, '"');
+        if (bytes)
+            lsv_out_puts(out, ",\"bytes\":true");
+        if (!dir_has_stat(dir, i)) {
+            lsv_out_puts(out, ",\"error\":\"stat\"}\n");
+            continue;
+        }
+        lsv_out_puts(out, ",\"type\":\"");
+        lsv_out_puts(out, type_name(dir->mode[i]));
+        lsv_out_puts(out, "\",\"mode\":");
+        lsv_out_u64(out, dir->mode[i] & 07777);
+        lsv_out_puts(out, ",\"size\":");
+        lsv_out_i64(out, (long long)dir->size[i]);
+        lsv_out_puts(out, ",\"mtime\":");
+        lsv_out_i64(out, (long long)dir->mtime[i]);
+        lsv_out_puts(out, ",\"uid\":");
+        lsv_out_u64(out, dir->uid[i]);
+        lsv_out_puts(out, ",\"gid\":");
+        lsv_out_u64(out, dir->gid[i]);
+        lsv_out_puts(out, ",\"ino\":");
+        lsv_out_u64(out, (unsigned long long)dir->ino[i]);
+        lsv_out_puts(out, ",\"nlink\":");
+        lsv_out_u64(out, (unsigned long long)dir->nlink[i]);
+        lsv_out_puts(out, "}\n");
+    }
+}
+
+/* ===============================================
+   Packed Binary Records
+   =============================================== */
+void lsv_render_bin_header(struct lsv_out *out)
+{
+    struct lsv_bin_header h = {
+        .magic = LSV_BIN_MAGIC,
+        .version = LSV_BIN_VERSION,
+        .record_size = sizeof(struct lsv_bin_record),
+    };
+    lsv_out_write(out, &h, sizeof(h));
+    // Pad so the first record is 8-byte aligned in an mmap'ed stream
+    lsv_out_write(out, "\0\0\0\0\0\0\0\0", LSV_BIN_PAD(sizeof(h)) - sizeof(h));
+}
+
+void render_binary(const struct lsv_dir *dir, const struct lsv_options *opts,
+                   struct lsv_out *out)
+{
+    (void)opts;
+    static const char zeros[8];
+    size_t dlen = strlen(dir->path);
+
+    for (size_t i = 0; i < dir->count; i++) {
+        struct lsv_bin_record rec = { .name_len = (uint32_t)(dlen + 1 + dir->name_len[i]) };
+        if (dir_has_stat(dir, i)) {
+            rec.mode = dir->mode[i];
+            rec.size = (uint64_t)dir->size[i];
+            rec.mtime = dir->mtime[i];
+            rec.uid = dir->uid[i];
+            rec.gid = dir->gid[i];
+            rec.ino = dir->ino[i];
+        } else {
+            rec.flags = LSV_BIN_NO_STAT;
+            rec.stat_errno = dir->stat_err ? dir->stat_err[i] : 0;
+        }
+        lsv_out_write(out, &rec, sizeof(rec));
+        put_path(out, dir, i);
+        lsv_out_write(out, zeros, LSV_BIN_PAD(rec.name_len) - rec.name_len);
+    }
+}
+
+/* ===============================================
+   NUL-Delimited Paths
+   =============================================== */
+void render_nul(const struct lsv_dir *dir, const struct lsv_options *opts,
+                struct lsv_out *out)
+{
+    (void)opts;
+    for (size_t i = 0; i < dir->count; i++) {
+        put_path(out, dir, i);
+        lsv_out_putc(out, '\0');
+    }
+}
@@ -0,0 +1,132 @@
+/*
+* liblsv: user and group name cache for -l
+*
+* getpwuid()/getgrgid() go through NSS on every call (files, nscd, LDAP,
+* ...). Long listings repeat the same handful of ids, so each id is
+* resolved once and its name kept in a small open-addressed table.
+* Unknown ids are cached too. ids_revalidate() drops both tables when
+* /etc/passwd or /etc/group changed, for processes that outlive an edit
+* (lsvd).
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+struct id_slot {
+    uint32_t id;
+    char    *name;      // NULL: slot unused
+};
+
+struct id_table {
+    struct id_slot *slots;
+    size_t          cap;
+    size_t          count;
+    struct timespec mtime;  // of the database file when filled
+};
+
+static struct id_table users;
+static struct id_table groups;
+
+static void table_clear(struct id_table *t)
+{
+    for (size_t i = 0; i < t->cap; i++)
+        free(t->slots[i].name);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+static struct id_slot *table_probe(const struct id_table *t, uint32_t id)
+{
+    size_t mask = t->cap - 1;
+    size_t i = (id * 2654435761u) & mask;
+
+    while (t->slots[i].name != NULL && t->slots[i].id != id)
+        i = (i + 1) & mask;
+    return &t->slots[i];
+}
+
+static int table_grow(struct id_table *t)
+{
+    size_t cap = t->cap ? t->cap * 2 : 64;
+    struct id_table grown = { .cap = cap, .mtime = t->mtime };
+
+    grown.slots = calloc(cap, sizeof(*grown.slots));
+    if (grown.slots == NULL)
+        return -1;
+    for (size_t i = 0; i < t->cap; i++) {
+        if (t->slots[i].name != NULL)
+            *table_probe(&grown, t->slots[i].id) = t->slots[i];
+    }
+    grown.count = t->count;
+    free(t->slots);
+    *t = grown;
+    return 0;
+}
+
+/* Returns the cached name of id, resolving it with lookup() on a miss */
+static const char *table_name(struct id_table *t, uint32_t id, const char *(*lookup)(uint32_t))
+{
+    if (t->cap > 0) {
+        struct id_slot *s = table_probe(t, id);
+        if (s->name != NULL)
+            return s->name;
+    }
+
+    const char *name = lookup(id);
+    if ((t->count + 1) * 4 > t->cap * 3 && table_grow(t) == -1)
+        return name;
+
+    struct id_slot *s = table_probe(t, id);
+    s->id = id;
+    s->name = strdup(name);
+    if (s->name == NULL)
+        return name;
+    t->count++;
+    return s->name;
+}
+
+static const char *lookup_user(uint32_t uid)
+{
+    struct passwd *pwd = getpwuid(uid);
+    return pwd ? pwd->pw_name : "unknown";
+}
+
+static const char *lookup_group(uint32_t gid)
+{
+    struct group *grp = getgrgid(gid);
+    return grp ? grp->gr_name : "unknown";
+}
+
+const char *user_name(uint32_t uid)
+{
+    return table_name(&users, uid, lookup_user);
+}
+
+const char *group_name(uint32_t gid)
+{
+    return table_name(&groups, gid, lookup_group);
+}
+
+static void revalidate(struct id_table *t, const char *db)
+{
+    struct stat st;
+    if (stat(db, &st) == -1)
+        return;
+    if (st.st_mtim.tv_sec != t->mtime.tv_sec || st.st_mtim.tv_nsec != t->mtime.tv_nsec) {
+        table_clear(t);
+        t->mtime = st.st_mtim;
+    }
+}
+
+void ids_revalidate(void)
+{
+    revalidate(&users, "/etc/passwd");
+    revalidate(&groups, "/etc/group");
+}
@@ -0,0 +1,646 @@
+/*
+* liblsv: directory loading and entry table
+*
+* This is the traversal that used to live inside do_ls() / do_ls_long().
+* Directories are read once into an entry table, sorted and handed to the
+* caller; nothing here prints. The recursive walker is in walk.c.
+*
+* The table is column-oriented (see struct lsv_dir in lsv_int.h): names
+* sit in one blob and every per-entry field is its own array, so sort
+* keys, widths and modes are scanned sequentially instead of chasing one
+* malloc'ed string and one struct per entry.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // for strcasecmp
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "lsv_int.h"
+
+void lsv_options_init(struct lsv_options *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->mode = LSV_MODE_COLUMNS;
+    opts->color = 1;
+    opts->prefetch = LSV_PREFETCH_AUTO;     // counting CPUs waits for a walk
+}
+
+/* Long listing, colors and the record formats all need lstat() data */
+int lsv_needs_stat(const struct lsv_options *opts)
+{
+    if (opts->need_stat)
+        return 1;
+    if (opts->format == LSV_FORMAT_TEXT)
+        return opts->mode == LSV_MODE_LONG || opts->color;
+    return opts->format != LSV_FORMAT_NUL;
+}
+
+/* Only the long text listing prints "-> target" */
+int lsv_needs_links(const struct lsv_options *opts)
+{
+    return opts->format == LSV_FORMAT_TEXT && opts->mode == LSV_MODE_LONG;
+}
+
+/* ===============================================
+   Entry Table
+   =============================================== */
+static int grow_column(void *colp, size_t elem, size_t cap)
+{
+    void **col = colp;
+    void *grown = realloc(*col, cap * elem);
+    if (grown == NULL)
+        return -1;
+    *col = grown;
+    return 0;
+}
+
+/* Makes room for n more bytes at the end of the name blob */
+static int reserve_names(struct lsv_dir *d, size_t n)
+{
+    if (d->names_len + n > d->names_cap) {
+        size_t cap = d->names_cap ? d->names_cap * 2 : 4096;
+        while (cap < d->names_len + n)
+            cap *= 2;
+        if (grow_column(&d->names, 1, cap) == -1)
+            return -1;
+        d->names_cap = cap;
+    }
+    return 0;
+}
+
+static int dir_push(struct lsv_dir *d, const char *name, unsigned char type, uint8_t flags)
+{
+    size_t len = strlen(name);
+
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        if (grow_column(&d->name_off, sizeof(*d->name_off), cap) == -1 ||
+            grow_column(&d->name_len, sizeof(*d->name_len), cap) == -1 ||
+            grow_column(&d->type, sizeof(*d->type), cap) == -1 ||
+            grow_column(&d->flags, sizeof(*d->flags), cap) == -1)
+            return -1;
+        d->cap = cap;
+    }
+    if (reserve_names(d, len + 1) == -1)
+        return -1;
+
+    memcpy(d->names + d->names_len, name, len + 1);
+    d->name_off[d->count] = (uint32_t)d->names_len;
+    d->name_len[d->count] = (uint16_t)len;
+    d->type[d->count] = type;
+    d->flags[d->count] = flags;
+    d->names_len += len + 1;
+    d->count++;
+    return 0;
+}
+
+/* Stat columns are sized once, after readdir() has counted the entries */
+static int alloc_stat_columns(struct lsv_dir *d)
+{
+    size_t n = d->count ? d->count : 1;
+
+    d->mode = malloc(n * sizeof(*d->mode));
+    d->nlink = malloc(n * sizeof(*d->nlink));
+    d->uid = malloc(n * sizeof(*d->uid));
+    d->gid = malloc(n * sizeof(*d->gid));
+    d->size = malloc(n * sizeof(*d->size));
+    d->mtime = malloc(n * sizeof(*d->mtime));
+    d->mtime_nsec = malloc(n * sizeof(*d->mtime_nsec));
+    d->blocks = malloc(n * sizeof(*d->blocks));
+    d->ino = malloc(n * sizeof(*d->ino));
+    d->stat_err = calloc(n, sizeof(*d->stat_err));
+    if (!d->mode || !d->nlink || !d->uid || !d->gid || !d->size || !d->mtime || !d->mtime_nsec ||
+        !d->blocks || !d->ino || !d->stat_err)
+        return -1;
+    return 0;
+}
+
+/* Without memory the listing just goes without "-> target" */
+static void alloc_link_column(struct lsv_dir *d)
+{
+    d->link_off = malloc((d->count ? d->count : 1) * sizeof(*d->link_off));
+    for (size_t i = 0; d->link_off != NULL && i < d->count; i++)
+        d->link_off[i] = LINK_NONE;
+}
+
+static void store_stat(struct lsv_dir *d, size_t i, const struct stat *st)
+{
+    d->mode[i] = st->st_mode;
+    d->nlink[i] = (uint32_t)st->st_nlink;
+    d->uid[i] = st->st_uid;
+    d->gid[i] = st->st_gid;
+    d->size[i] = st->st_size;
+    d->mtime[i] = st->st_mtime;
+    d->mtime_nsec[i] = (uint32_t)st->st_mtim.tv_nsec;
+    d->blocks[i] = st->st_blocks;
+    d->ino[i] = st->st_ino;
+    d->flags[i] |= ENTRY_HAS_STAT;
+}
+
+/* Appends entry i's symlink target to the name blob. Read right after
+   the lstat(), relative to the same directory fd: no path building and
+   no allocation per link. An unreadable target is simply not shown. */
+static void store_link(struct lsv_dir *d, int fd, size_t i)
+{
+    // lstat() gives the target's length (0 on some pseudo file systems);
+    // a read that fills the room may be cut short, so retry with more
+    size_t room = d->size[i] > 0 ? (size_t)d->size[i] + 1 : 256;
+    ssize_t n;
+
+    for (;;) {
+        if (reserve_names(d, room) == -1)
+            return;
+        n = readlinkat(fd, dir_name(d, i), d->names + d->names_len, room);
+        if (n < 0)
+            return;
+        if ((size_t)n < room)
+            break;
+        room *= 2;
+    }
+    d->names[d->names_len + (size_t)n] = '\0';
+    d->link_off[i] = (uint32_t)d->names_len;
+    d->names_len += (size_t)n + 1;
+}
+
+/* ===============================================
+   Sorting
+   =============================================== */
+struct sort_item {
+    uint64_t key;   // first 8 case-folded bytes, big-endian
+    uint32_t key2;  // name sort: the next 4, in what would be padding
+    uint32_t idx;
+};
+
+static inline unsigned char fold_ascii(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+/* First 8 bytes of s, zero-padded, as a big-endian number */
+static uint64_t prefix_key(const unsigned char *s, size_t len)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; i++)
+        key = (key << 8) | (i < len ? s[i] : 0);
+    return key;
+}
+
+/* Name sort keys: the first 12 case-folded bytes, zero-padded, split
+   over key and key2 in one pass */
+static void fold_keys(struct sort_item *item, const char *name, size_t len)
+{
+    uint64_t key = 0;
+    uint32_t key2 = 0;
+    for (size_t i = 0; i < 12; i++) {
+        unsigned char c = i < len ? (unsigned char)name[i] : 0;
+        if (c >= 'A' && c <= 'Z')
+            c = (unsigned char)(c + 'a' - 'A');
+        if (i < 8)
+            key = (key << 8) | c;
+        else
+            key2 = (key2 << 8) | c;
+    }
+    item->key = key;
+    item->key2 = key2;
+}
+
+static int compare_names(const struct lsv_dir *d, size_t a, size_t b)
+{
+    const char *nameA = dir_name(d, a);
+    const char *nameB = dir_name(d, b);
+    int rc = strcasecmp(nameA, nameB);
+    return rc != 0 ? rc : strcmp(nameA, nameB);
+}
+
+static int compare_items(const void *a, const void *b, void *arg)
+{
+    const struct sort_item *itemA = a;
+    const struct sort_item *itemB = b;
+
+    if (itemA->key != itemB->key)
+        return itemA->key < itemB->key ? -1 : 1;
+    if (itemA->key2 != itemB->key2)
+        return itemA->key2 < itemB->key2 ? -1 : 1;
+    // Same 12-byte prefix: fall back to the full names
+    return compare_names(arg, itemA->idx, itemB->idx);
+}
+
+/* -v and --collate sort on a byte key computed once per name and kept in
+   one blob beside the table. The sort items carry each key's first 8
+   bytes, so most comparisons are one integer compare; ties memcmp() the
+   full keys, and no name is reparsed per comparison. */
+struct sort_keys {
+    const struct lsv_dir *dir;
+    unsigned char        *blob;
+    size_t                cap;
+    uint32_t             *off;      // by table index
+    uint32_t             *len;
+};
+
+/* Version keys (-v): the name split into text and digit runs, packed so
+   that memcmp() orders it naturally:
+     - text bytes are case-folded and copied;
+     - a digit run becomes '0', the number of its significant digits and
+       those digits, so "9" < "10" < "100" and equal lengths compare
+       digit by digit. The '0' marker keeps numbers where digits sort
+       among the other characters.
+   A run of 1 digit grows to 3 bytes, the worst case. */
+static size_t pack_version_key(const char *name, size_t len, unsigned char *out)
+{
+    size_t k = 0;
+
+    for (size_t i = 0; i < len; ) {
+        if (name[i] < '0' || name[i] > '9') {
+            out[k++] = fold_ascii((unsigned char)name[i++]);
+            continue;
+        }
+        size_t start = i;
+        while (i < len && name[i] >= '0' && name[i] <= '9')
+            i++;
+        while (start + 1 < i && name[start] == '0')
+            start++;    // leading zeros, but "000" keeps one digit
+        out[k++] = '0';
+        out[k++] = (unsigned char)(i - start);
+        memcpy(out + k, name + start, i - start);
+        k += i - start;
+    }
+    return k;
+}
+
+/* Collation keys (--collate): strxfrm() output, which memcmp() orders
+   exactly as strcoll() orders the names under the current LC_COLLATE.
+   Returns the key length, or (size_t)-1 without memory. */
+static size_t collate_key(struct sort_keys *sk, size_t off, const char *name)
+{
+    for (;;) {
+        size_t len = strxfrm((char *)sk->blob + off, name, sk->cap - off);
+        if (len < sk->cap - off)
+            return len;
+        // Too short: strxfrm() told us how much room the key needs
+        size_t cap = (off + len + 1) * 2;
+        unsigned char *grown = realloc(sk->blob, cap);
+        if (grown == NULL)
+            return (size_t)-1;
+        sk->blob = grown;
+        sk->cap = cap;
+    }
+}
+
+/* Builds every name's key into sk and seeds items with the key prefixes */
+static int build_sort_keys(const struct lsv_dir *d, int sort, struct sort_item *items,
+                           struct sort_keys *sk)
+{
+    size_t n = d->count;
+
+    sk->dir = d;
+    sk->cap = sort == LSV_SORT_VERSION ? d->names_len * 3 + 1 : d->names_len * 4 + 64;
+    sk->blob = malloc(sk->cap);
+    sk->off = malloc(n * sizeof(*sk->off));
+    sk->len = malloc(n * sizeof(*sk->len));
+    if (sk->blob == NULL || sk->off == NULL || sk->len == NULL)
+        return -1;
+
+    size_t off = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t len;
+        if (sort == LSV_SORT_VERSION)
+            len = pack_version_key(dir_name(d, i), d->name_len[i], sk->blob + off);
+        else if ((len = collate_key(sk, off, dir_name(d, i))) == (size_t)-1)
+            return -1;
+        sk->off[i] = (uint32_t)off;
+        sk->len[i] = (uint32_t)len;
+        items[i].key = prefix_key(sk->blob + off, len);
+        items[i].idx = (uint32_t)i;
+        off += len;
+    }
+    return 0;
+}
+
+static void free_sort_keys(struct sort_keys *sk)
+{
+    free(sk->blob);
+    free(sk->off);
+    free(sk->len);
+}
+
+static int compare_keys(const void *a, const void *b, void *arg)
+{
+    const struct sort_item *itemA = a;
+    const struct sort_item *itemB = b;
+    const struct sort_keys *sk = arg;
+
+    if (itemA->key != itemB->key)
+        return itemA->key < itemB->key ? -1 : 1;
+
+    size_t lenA = sk->len[itemA->idx], lenB = sk->len[itemB->idx];
+    int rc = memcmp(sk->blob + sk->off[itemA->idx], sk->blob + sk->off[itemB->idx],
+                    lenA < lenB ? lenA : lenB);
+    if (rc == 0 && lenA != lenB)
+        rc = lenA < lenB ? -1 : 1;
+    // Equal keys ("v07" and "v7", or names the locale ranks the same):
+    // order them as plain names
+    return rc != 0 ? rc : compare_names(sk->dir, itemA->idx, itemB->idx);
+}
+
+/* Reorders one column by items[].idx through a shared scratch buffer */
+static void gather(void *col, size_t elem, const struct sort_item *items, size_t n, char *scratch)
+{
+    if (col == NULL)
+        return;
+    const char *src = col;
+    for (size_t i = 0; i < n; i++)
+        memcpy(scratch + i * elem, src + (size_t)items[i].idx * elem, elem);
+    memcpy(col, scratch, n * elem);
+}
+
+/* Sorts case-insensitively (or by version or locale collation), then
+   physically reorders every column and the name blob so layout and
+   rendering walk memory front to back */
+static void sort_dir(struct lsv_dir *d, int sort)
+{
+    size_t n = d->count;
+    struct sort_item *items = malloc(n * sizeof(*items));
+    char *scratch = malloc(n * sizeof(uint64_t));
+    if (items == NULL || scratch == NULL) {
+        free(items);
+        free(scratch);
+        return;     // leave the table in readdir() order
+    }
+
+    struct sort_keys sk = { .blob = NULL };
+    if (sort != LSV_SORT_NAME && build_sort_keys(d, sort, items, &sk) == 0) {
+        qsort_r(items, n, sizeof(*items), compare_keys, &sk);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            fold_keys(&items[i], dir_name(d, i), d->name_len[i]);
+            items[i].idx = (uint32_t)i;
+        }
+        qsort_r(items, n, sizeof(*items), compare_items, d);
+    }
+    free_sort_keys(&sk);
+
+    gather(d->name_off, sizeof(*d->name_off), items, n, scratch);
+    gather(d->name_len, sizeof(*d->name_len), items, n, scratch);
+    gather(d->width, sizeof(*d->width), items, n, scratch);
+    gather(d->type, sizeof(*d->type), items, n, scratch);
+    gather(d->flags, sizeof(*d->flags), items, n, scratch);
+    gather(d->mode, sizeof(*d->mode), items, n, scratch);
+    gather(d->nlink, sizeof(*d->nlink), items, n, scratch);
+    gather(d->uid, sizeof(*d->uid), items, n, scratch);
+    gather(d->gid, sizeof(*d->gid), items, n, scratch);
+    gather(d->size, sizeof(*d->size), items, n, scratch);
+    gather(d->mtime, sizeof(*d->mtime), items, n, scratch);
+    gather(d->mtime_nsec, sizeof(*d->mtime_nsec), items, n, scratch);
+    gather(d->blocks, sizeof(*d->blocks), items, n, scratch);
+    gather(d->ino, sizeof(*d->ino), items, n, scratch);
+    gather(d->stat_err, sizeof(*d->stat_err), items, n, scratch);
+    gather(d->link_off, sizeof(*d->link_off), items, n, scratch);
+    free(scratch);
+    free(items);
+
+    // Rewrite the blob in sorted order; offsets stay valid if this fails
+    char *names = malloc(d->names_len ? d->names_len : 1);
+    if (names == NULL)
+        return;
+    size_t off = 0;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(names + off, dir_name(d, i), (size_t)d->name_len[i] + 1);
+        d->name_off[i] = (uint32_t)off;
+        off += (size_t)d->name_len[i] + 1;
+        const char *target = dir_link(d, i);
+        if (target != NULL) {
+            size_t len = strlen(target) + 1;
+            memcpy(names + off, target, len);
+            d->link_off[i] = (uint32_t)off;
+            off += len;
+        }
+    }
+    free(d->names);
+    d->names = names;
+    d->names_cap = d->names_len;
+}
+
+/* ===============================================
+   Loading
+   =============================================== */
+static int compare_ino(const void *a, const void *b)
+{
+    uint64_t x = ((const struct sort_item *)a)->key, y = ((const struct sort_item *)b)->key;
+    return (x > y) - (x < y);
+}
+
+/* Stats entries from..to of the stat order (NULL: table order) */
+static void stat_entries(struct lsv_dir *d, int fd, const struct sort_item *order,
+                         size_t from, size_t to)
+{
+    struct stat st;
+    for (size_t k = from; k < to; k++) {
+        size_t i = order ? order[k].idx : k;
+        if (fstatat(fd, dir_name(d, i), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            store_stat(d, i, &st);
+            if (d->link_off != NULL && S_ISLNK(st.st_mode))
+                store_link(d, fd, i);
+        } else {
+            d->stat_err[i] = errno;
+        }
+    }
+}
+
+struct lsv_dir *lsv_dir_load(const char *path, const struct lsv_options *opts)
+{
+    struct lsv_throttle *throttle = opts->throttle;
+    uint64_t started = throttle ? throttle_begin(throttle, THROTTLE_DIR, 1) : 0;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dp = fd == -1 ? NULL : fdopendir(fd);
+    struct lsv_dir *d = dp == NULL ? NULL : calloc(1, sizeof(*d));
+    if (d == NULL || (d->path = strdup(path)) == NULL) {
+        // One exit for every failure, so the open() stays charged
+        int saved = errno;
+        free(d);
+        if (dp != NULL)
+            closedir(dp);
+        else if (fd != -1)
+            close(fd);
+        if (throttle != NULL)
+            throttle_end(throttle, THROTTLE_DIR, 1, 0, started);
+        errno = saved;
+        return NULL;
+    }
+
+    // Step 1: Gather all entries (hidden and filtered-out names are skipped),
+    // with their inode numbers when lstat() is to go in inode order
+    struct sort_item *by_ino = NULL;
+    size_t by_ino_cap = 0;
+    int inode_order = opts->inode_order && lsv_needs_stat(opts);
+    size_t seen = 0;    // entries read, kept or not
+    struct dirent *entry;
+    errno = 0;
+    while ((entry = readdir(dp)) != NULL) {
+        seen++;
+        if (hidden_skip(entry->d_name, opts->hidden))
+            continue;
+
+        int verdict = FILTER_KEEP;
+        if (opts->filter != NULL) {
+            verdict = filter_check(opts->filter, fd, entry->d_name, entry->d_type);
+            if (verdict == FILTER_DROP) {
+                errno = 0;
+                continue;
+            }
+        }
+        uint8_t flags = verdict == FILTER_PRUNE ? ENTRY_PRUNE : 0;
+        if (dir_push(d, entry->d_name, entry->d_type, flags) == -1) {
+            d->read_errno = ENOMEM;
+            break;
+        }
+        if (inode_order && d->count > by_ino_cap) {
+            struct sort_item *grown = realloc(by_ino, d->cap * sizeof(*by_ino));
+            if (grown == NULL) {
+                inode_order = 0;    // fall back to readdir() order
+            } else {
+                by_ino = grown;
+                by_ino_cap = d->cap;
+            }
+        }
+        if (inode_order) {
+            by_ino[d->count - 1].key = entry->d_ino;
+            by_ino[d->count - 1].idx = (uint32_t)(d->count - 1);
+        }
+        errno = 0;
+    }
+    if (errno != 0 && d->read_errno == 0)
+        d->read_errno = errno;
+    if (throttle != NULL)
+        throttle_end(throttle, THROTTLE_DIR, 1, seen, started);
+
+    // Step 2: lstat() relative to the open directory when metadata is needed,
+    // reading symlink targets in the same pass for -l.
+    // On a cold cache each lstat() reads an inode table block; ascending
+    // inode numbers turn those reads into one forward sweep of the disk.
+    if (inode_order && d->count > 1)
+        qsort(by_ino, d->count, sizeof(*by_ino), compare_ino);
+    if (lsv_needs_stat(opts)) {
+        d->has_self = fstat(fd, &d->self) == 0;
+        if (lsv_needs_links(opts))
+            alloc_link_column(d);
+        if (alloc_stat_columns(d) == -1) {
+            d->read_errno = ENOMEM;
+        } else if (throttle == NULL) {
+            stat_entries(d, fd, inode_order ? by_ino : NULL, 0, d->count);
+        } else {
+            for (size_t i = 0; i < d->count; i += THROTTLE_BATCH) {
+                size_t n = d->count - i < THROTTLE_BATCH ? d->count - i : THROTTLE_BATCH;
+                started = throttle_begin(throttle, THROTTLE_STAT, n);
+                stat_entries(d, fd, inode_order ? by_ino : NULL, i, i + n);
+                throttle_end(throttle, THROTTLE_STAT, n, n, started);
+            }
+        }
+    }
+    closedir(dp);
+    free(by_ino);
+
+    // Step 3: Cache display widths for column layout
+    if (opts->format == LSV_FORMAT_TEXT && d->count > 0) {
+        d->width = malloc(d->count * sizeof(*d->width));
+        for (size_t i = 0; d->width != NULL && i < d->count; i++)
+            d->width[i] = (uint16_t)display_width(dir_name(d, i), d->name_len[i]);
+    }
+
+    // Step 4: Sort alphabetically (case-insensitive), by version (-v) or
+    // by the locale's collation (--collate)
+    if (d->count > 1)
+        sort_dir(d, opts->sort);
+
+    return d;
+}
+
+void lsv_dir_free(struct lsv_dir *dir)
+{
+    if (dir == NULL)
+        return;
+    free(dir->names);
+    free(dir->name_off);
+    free(dir->name_len);
+    free(dir->width);
+    free(dir->type);
+    free(dir->flags);
+    free(dir->mode);
+    free(dir->nlink);
+    free(dir->uid);
+    free(dir->gid);
+    free(dir->size);
+    free(dir->mtime);
+    free(dir->mtime_nsec);
+    free(dir->blocks);
+    free(dir->ino);
+    free(dir->stat_err);
+    free(dir->link_off);
+    free(dir->path);
+    free(dir);
+}
+
+const char *lsv_dir_path(const struct lsv_dir *dir)
+{
+    return dir->path;
+}
+
+size_t lsv_dir_count(const struct lsv_dir *dir)
+{
+    return dir->count;
+}
+
+int lsv_dir_errno(const struct lsv_dir *dir)
+{
+    return dir->read_errno;
+}
+
+int lsv_dir_entry(const struct lsv_dir *dir, size_t index, struct lsv_entry *out)
+{
+    if (index >= dir->count)
+        return 0;
+
+    memset(out, 0, sizeof(*out));
+    out->name = dir_name(dir, index);
+    out->name_len = dir->name_len[index];
+    out->width = dir->width ? dir->width[index] : 0;
+    out->type = dir->type[index];
+    out->has_stat = dir_has_stat(dir, index);
+    out->link_target = dir_link(dir, index);
+    if (out->has_stat) {
+        out->st.st_mode = dir->mode[index];
+        out->st.st_nlink = dir->nlink[index];
+        out->st.st_uid = dir->uid[index];
+        out->st.st_gid = dir->gid[index];
+        out->st.st_size = dir->size[index];
+        out->st.st_mtim.tv_sec = dir->mtime[index];
+        out->st.st_mtim.tv_nsec = dir->mtime_nsec[index];
+        out->st.st_blocks = dir->blocks[index];
+        out->st.st_ino = dir->ino[index];
+        out->st.st_dev = dir->self.st_dev;
+    }
+    return 1;
+}
+
+void lsv_iter_init(struct lsv_iter *it, const struct lsv_dir *dir)
+{
+    it->dir = dir;
+    it->pos = 0;
+}
+
+int lsv_iter_next(struct lsv_iter *it, struct lsv_entry *out)
+{
+    if (!lsv_dir_entry(it->dir, it->pos, out))
+        return 0;
+    it->pos++;
+    return 1;
+}
@@ -0,0 +1,439 @@
+/*
+* liblsv - embeddable directory listing library
+*
+* The traversal, entry table and renderers behind the lsv command are
+* exposed here so other programs can list directories in-process instead
+* of spawning lsv and parsing its output.
+*
+* Typical use:
+*       struct lsv_options opts;
+*       lsv_options_init(&opts);
+*       opts.recursive = 1;
+*       lsv_walk("/data", &opts, &ops, ctx);   // ops.visit called per directory
+*
+* Inside a visit callback the directory's entry table can be iterated:
+*       struct lsv_iter it;
+*       struct lsv_entry e;
+*       lsv_iter_init(&it, dir);
+*       while (lsv_iter_next(&it, &e))
+*           ...use e.name, e.st...
+*/
+
+#ifndef LSV_H
+#define LSV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* ===============================================
+   Options
+   =============================================== */
+enum lsv_mode {
+    LSV_MODE_COLUMNS = 0,   // default: down then across
+    LSV_MODE_ACROSS,        // -x: left to right
+    LSV_MODE_LONG,          // -l: one entry per line with metadata
+    LSV_MODE_ONE            // -1: one name per line
+};
+
+/* Output formats. Everything but TEXT is meant for programs: no
+   headers, no padding, no color and no terminal width detection. */
+enum lsv_format {
+    LSV_FORMAT_TEXT = 0,    // human columns / long listing
+    LSV_FORMAT_NUL,         // --format=nul: path\0 per entry
+    LSV_FORMAT_JSONL,       // --format=jsonl: one JSON object per line
+    LSV_FORMAT_BINARY       // --format=binary: struct lsv_bin_record stream
+};
+
+struct lsv_filter;  // compiled --include/--exclude/--prune patterns
+struct lsv_colors;  // parsed LS_COLORS palette
+struct lsv_cache;   // directory cache for long-running callers
+struct lsv_throttle;    // rate limits for background scans
+
+/* Which dot-names a directory read keeps. "." and ".." are listed but
+   never descended into; --count and snapshots, which describe the tree
+   rather than a listing, treat LSV_HIDDEN_ALL as LSV_HIDDEN_ALMOST. */
+enum lsv_hidden {
+    LSV_HIDDEN_NONE = 0,    // default: skip every name starting with '.'
+    LSV_HIDDEN_ALMOST,      // -A: dotfiles, but not "." and ".."
+    LSV_HIDDEN_ALL          // -a: everything, "." and ".." included
+};
+
+/* Entry order within a directory */
+enum lsv_sort {
+    LSV_SORT_NAME = 0,      // default: case-insensitive by name
+    LSV_SORT_VERSION,       // -v: digit runs compare by value ("build-9" < "build-10")
+    LSV_SORT_COLLATE        // --collate: strcoll() order of the current LC_COLLATE
+};
+
+/* Owner and group columns of the long listing. Names go through NSS
+   (getpwuid()/getgrgid()); numeric and omitted columns never touch it. */
+enum lsv_ids {
+    LSV_IDS_NAMES    = 0,   // default: user and group names
+    LSV_IDS_NUMERIC  = 1,   // -n: numeric uid and gid
+    LSV_IDS_NO_OWNER = 2,   // -g: omit the owner column
+    LSV_IDS_NO_GROUP = 4    // -o: omit the group column
+};
+
+struct lsv_options {
+    int mode;        // enum lsv_mode
+    int format;      // enum lsv_format
+    int recursive;   // -R
+    int color;       // colorize names by file type
+    int need_stat;   // always lstat() entries (callers reading lsv_entry.st)
+    const struct lsv_filter *filter;    // NULL: keep every entry
+    const struct lsv_colors *colors;    // NULL: lsv_colors_default()
+    int prefetch;    // -R: walk events queued ahead of the visitor (0: serial,
+                     // LSV_PREFETCH_AUTO: LSV_PREFETCH_DEFAULT with 2+ CPUs)
+    struct lsv_cache *cache;            // NULL: load every directory afresh
+    struct lsv_throttle *throttle;      // NULL: full speed
+    int inode_order; // lstat() entries and open subdirectories in inode order
+    int ids;         // enum lsv_ids flags: -l owner and group columns
+    int sort;        // enum lsv_sort
+    int hidden;      // enum lsv_hidden
+};
+
+#define LSV_PREFETCH_DEFAULT 16
+#define LSV_PREFETCH_AUTO    (-1)   // resolved when a walk first needs it
+
+void lsv_options_init(struct lsv_options *opts);
+
+/* ===============================================
+   Colors (LS_COLORS)
+   =============================================== */
+/* Parses an LS_COLORS string (NULL or "" selects the built-in palette) */
+struct lsv_colors *lsv_colors_parse(const char *spec);
+const struct lsv_colors *lsv_colors_default(void);     // from $LS_COLORS, cached
+void lsv_colors_free(struct lsv_colors *colors);
+
+/* ===============================================
+   Name Filters
+   =============================================== */
+enum lsv_filter_kind {
+    LSV_FILTER_INCLUDE = 0,     // only list non-directories matching one
+    LSV_FILTER_EXCLUDE,         // drop matching entries and their subtrees
+    LSV_FILTER_PRUNE            // list matching entries, never descend
+};
+
+/* Patterns are globs matched against the bare name, or POSIX extended
+   regexes when written as "re:<regex>". lsv_filter_add() returns -1
+   with errno EINVAL for a bad regex. Call lsv_filter_compile() once
+   after the last add and before walking. */
+struct lsv_filter *lsv_filter_new(void);
+int lsv_filter_add(struct lsv_filter *f, int kind, const char *pattern);
+int lsv_filter_compile(struct lsv_filter *f);
+void lsv_filter_free(struct lsv_filter *f);
+
+/* ===============================================
+   Entry Table
+   =============================================== */
+struct lsv_dir;     // one loaded and sorted directory (opaque)
+struct lsv_out;     // buffered writer (see Buffered Output below)
+
+/* Read-only view of a single entry, filled by the accessors below */
+struct lsv_entry {
+    const char   *name;
+    size_t        name_len;
+    unsigned      width;      // display cells (text format only, else 0)
+    unsigned char type;       // DT_* value reported by readdir()
+    int           has_stat;   // st is valid only when non-zero
+    struct stat   st;         // lstat() result
+    const char   *link_target; // symlink target (long text loads), else NULL
+};
+
+/* Loads and sorts a directory. Returns NULL with errno set on failure. */
+struct lsv_dir *lsv_dir_load(const char *path, const struct lsv_options *opts);
+void lsv_dir_free(struct lsv_dir *dir);
+
+const char *lsv_dir_path(const struct lsv_dir *dir);
+size_t lsv_dir_count(const struct lsv_dir *dir);
+int lsv_dir_errno(const struct lsv_dir *dir);   // readdir() error, 0 if none
+int lsv_dir_entry(const struct lsv_dir *dir, size_t index, struct lsv_entry *out);
+
+struct lsv_iter {
+    const struct lsv_dir *dir;
+    size_t pos;
+};
+
+void lsv_iter_init(struct lsv_iter *it, const struct lsv_dir *dir);
+int lsv_iter_next(struct lsv_iter *it, struct lsv_entry *out);
+
+/* ===============================================
+   Recursive Walker
+   =============================================== */
+struct lsv_walk_ops {
+    /* Called once per directory in listing order (pre-order).
+       depth is 0 for the root. A non-zero return stops the walk. */
+    int (*visit)(const struct lsv_dir *dir, int depth, void *ctx);
+
+    /* Called when a directory cannot be opened ("opendir") or was
+       only partially read ("readdir"). Optional. */
+    void (*error)(const char *path, const char *what, int err, void *ctx);
+
+    /* Called after all of a directory's subdirectories were walked
+       (post-order), with the same dir and depth as visit. Optional. */
+    void (*leave)(const struct lsv_dir *dir, int depth, void *ctx);
+};
+
+/* Returns 0, or the first non-zero value returned by ops->visit.
+   With opts->recursive and opts->prefetch > 0 a reader thread loads and
+   stats directories up to prefetch steps ahead; every callback still
+   runs on the calling thread, in the same order as a serial walk. */
+int lsv_walk(const char *root, const struct lsv_options *opts,
+             const struct lsv_walk_ops *ops, void *ctx);
+
+/* Walks each root next_root() returns, in order, as lsv_walk() would one
+   by one; NULL ends the stream. The string must stay valid until the
+   next call. With opts->prefetch > 0 next_root() is called from the
+   reader thread, which loads the next roots while earlier ones are
+   visited (also without opts->recursive). */
+int lsv_walk_many(const char *(*next_root)(void *src), void *src,
+                  const struct lsv_options *opts, const struct lsv_walk_ops *ops, void *ctx);
+
+/* Serial walk that survives interruption. Every interval seconds, and
+   when ops->visit returns non-zero (the directory then stays pending),
+   the directories still to visit and out's file offset are saved to
+   cp_path, atomically. With resume set the walk restarts from cp_path
+   and a regular-file out is cut back to the saved offset first. The
+   checkpoint is removed once the walk completes. ops->leave must be
+   NULL. Returns 0 when complete, 1 when stopped by ops->visit, or -1 with
+   errno set (EXDEV: cp_path belongs to another root). */
+int lsv_walk_checkpointed(const char *root, const struct lsv_options *opts,
+                          const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out,
+                          const char *cp_path, unsigned interval, int resume);
+
+/* ===============================================
+   Background Scanning
+   =============================================== */
+/* Moves the calling process to the idle I/O class (threads started
+   afterwards inherit it). Returns -1 with errno set on failure. */
+int lsv_nice_io(void);
+
+/* Limits directory loads and lstat() calls per second (0: no limit).
+   With adaptive set, the scan also slows down while the file system's
+   latency is well above what it was earlier in the walk. Set it as
+   opts->throttle; it also counts and times those calls. */
+struct lsv_throttle *lsv_throttle_new(double dirs_per_sec, double stats_per_sec, int adaptive);
+void lsv_throttle_free(struct lsv_throttle *throttle);
+
+struct lsv_throttle_stats {
+    uint64_t dirs;          // directories read
+    uint64_t stats;         // lstat() calls
+    double   dir_us;        // average time to open and read a directory
+    double   stat_us;       // average lstat() time
+    double   waited_sec;    // time spent sleeping for the limits
+    uint64_t backoffs;      // adaptive slowdowns
+    double   scale_min;     // lowest duty cycle reached (1: never slowed)
+};
+
+void lsv_throttle_stats(const struct lsv_throttle *throttle, struct lsv_throttle_stats *out);
+
+/* ===============================================
+   Directory Cache
+   =============================================== */
+/* Keeps up to max_dirs loaded directories for lsv_walk() with
+   opts->cache set, revalidated by mtime and inotify. Walks that use a
+   cache run serially. Call lsv_cache_sync() before each walk to apply
+   changes seen since the last one. */
+struct lsv_cache *lsv_cache_new(size_t max_dirs);
+void lsv_cache_sync(struct lsv_cache *cache);
+void lsv_cache_free(struct lsv_cache *cache);
+
+/* ===============================================
+   Daemon Protocol (lsvd)
+   =============================================== */
+/* $LSVD_SOCKET, else $XDG_RUNTIME_DIR/lsvd.sock, else /tmp/lsvd-UID.sock */
+int lsv_daemon_path(char *buf, size_t size);
+
+struct lsv_request {
+    int         conn;
+    int         cwd;         // client's working directory
+    int         out;         // client's stdout
+    int         err;         // client's stderr
+    int         argc;
+    char      **argv;        // argv[0] is the client's program name
+    const char *ls_colors;   // client's $LS_COLORS, NULL if unset
+    const char *lc_all;      // client's $LC_ALL, $LC_COLLATE and $LANG,
+    const char *lc_collate;  // which --collate loads the order from;
+    const char *lang;        // NULL if unset
+    char       *buf;
+};
+
+/* Server: binds a socket at path. A socket left by a daemon that is gone
+   is replaced; a live daemon's socket fails with EADDRINUSE and anything
+   else at path with EEXIST. Returns the listening fd, or -1. */
+int lsv_daemon_listen(const char *path);
+int lsv_daemon_accept(int listen_fd, struct lsv_request *req);
+void lsv_daemon_reply(struct lsv_request *req, int status);  // also frees req
+
+/* Client: runs argv in the daemon with this process's cwd, stdout and
+   stderr. Returns the listing's exit status, or -1 with errno set. The
+   daemon serves one request at a time, so a long listing delays the
+   requests queued behind it. */
+int lsv_daemon_call(const char *path, int argc, char *const argv[]);
+
+/* ===============================================
+   Snapshots and Diffs
+   =============================================== */
+struct lsv_snapshot;    // an mmap'ed snapshot file
+
+/* Walks root (honoring opts->filter) and writes every entry in tree
+   order to out_path, atomically. Directory errors go to ops->error. */
+int lsv_snapshot_write(const char *root, const struct lsv_options *opts,
+                       const struct lsv_walk_ops *ops, void *ctx, const char *out_path);
+struct lsv_snapshot *lsv_snapshot_open(const char *path);   // NULL, errno EINVAL if not a snapshot
+void lsv_snapshot_close(struct lsv_snapshot *snap);
+
+/* Don't read live directories whose entry (mtime included) is unchanged:
+   take their listing from the snapshot and only lstat() their
+   subdirectories. Structural changes are all found; in-place edits of
+   files in such directories are not. */
+#define LSV_DIFF_QUICK 1
+
+/* Print "A|D|M<TAB>path" for each added, deleted or modified entry in one
+   linear merge. Return the number of differences, or -1 if a snapshot is
+   corrupt. */
+long lsv_diff_snapshots(const struct lsv_snapshot *old_snap, const struct lsv_snapshot *new_snap,
+                        struct lsv_out *out);
+long lsv_diff_tree(const struct lsv_snapshot *old_snap, const char *root,
+                   const struct lsv_options *opts, int flags,
+                   const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out);
+
+/* Snapshot query: every predicate must hold. lsv_query_init() sets
+   them all to "any". */
+struct lsv_query {
+    const char *under;      // subtree: absolute below the snapshot's root, or relative to it
+    uint64_t    min_size;   // bytes, inclusive
+    uint64_t    max_size;
+    int64_t     min_mtime;  // nanoseconds since the epoch, inclusive
+    int64_t     max_mtime;
+    uint32_t    type;       // S_IFMT bits (S_IFREG, S_IFDIR, ...), 0: any
+    int64_t     uid;        // owner, -1: any
+    const char *name;       // fnmatch() glob on the entry's name, NULL: any
+};
+
+void lsv_query_init(struct lsv_query *q);
+
+/* Prints the path (relative to the snapshot root) of every matching
+   entry, in tree order, each followed by terminator. Returns the number
+   of matches, or -1 with errno ENOENT (under is not in the snapshot) or
+   EINVAL (corrupt snapshot). */
+long lsv_snapshot_query(const struct lsv_snapshot *snap, const struct lsv_query *q,
+                        char terminator, struct lsv_out *out);
+
+/* ===============================================
+   Disk Usage (-s / --du)
+   =============================================== */
+struct lsv_du;      // bottom-up size accumulator (opaque)
+
+struct lsv_du_totals {
+    uint64_t blocks;    // 512-byte st_blocks units
+    uint64_t bytes;     // sum of st_size
+    uint64_t entries;   // files and directories below (not counting itself)
+};
+
+/* top > 0 keeps only the N largest directories (by blocks) until
+   lsv_du_finish(); top == 0 prints each directory as it is left.
+   Drive it from lsv_walk(): visit -> lsv_du_visit, leave -> lsv_du_leave. */
+struct lsv_du *lsv_du_new(size_t top);
+int lsv_du_visit(struct lsv_du *du, const struct lsv_dir *dir, int depth);
+void lsv_du_leave(struct lsv_du *du, const struct lsv_dir *dir, int depth,
+                  struct lsv_du_totals *total, struct lsv_out *out);
+void lsv_du_finish(struct lsv_du *du, struct lsv_out *out);
+void lsv_du_free(struct lsv_du *du);
+
+/* ===============================================
+   Count Only (--count)
+   =============================================== */
+/* Walks with getdents64() and d_type only (no stat, sort or per-entry
+   storage). Prints "count<TAB>path" per directory, post-order, and
+   returns the number of entries found under root. Only ops->error is
+   used; opts->recursive selects whether subdirectories are counted. */
+uint64_t lsv_count(const char *root, const struct lsv_options *opts,
+                   const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out);
+
+/* ===============================================
+   Top-N Files (--top N --by size|mtime)
+   =============================================== */
+enum lsv_top_key {
+    LSV_TOP_SIZE = 0,
+    LSV_TOP_MTIME
+};
+
+struct lsv_top;     // bounded ranking of regular files (opaque)
+
+/* Memory is O(n). Call lsv_top_visit() from a walker visit callback. */
+struct lsv_top *lsv_top_new(size_t n, int by);
+void lsv_top_visit(struct lsv_top *top, const struct lsv_dir *dir);
+void lsv_top_finish(struct lsv_top *top, struct lsv_out *out);
+void lsv_top_free(struct lsv_top *top);
+
+/* ===============================================
+   Buffered Output
+   =============================================== */
+struct lsv_out;     // buffered writer over a file descriptor (opaque)
+
+struct lsv_out *lsv_out_open(int fd);
+void lsv_out_splice(struct lsv_out *out);    // opt in to vmsplice() for pipes
+int lsv_out_flush(struct lsv_out *out);      // -1 once any write failed
+int lsv_out_close(struct lsv_out *out);      // flushes and frees
+void lsv_out_write(struct lsv_out *out, const void *data, size_t n);
+void lsv_out_puts(struct lsv_out *out, const char *s);
+void lsv_out_putc(struct lsv_out *out, char c);
+void lsv_out_pad(struct lsv_out *out, int n);
+void lsv_out_u64(struct lsv_out *out, unsigned long long v);
+void lsv_out_i64(struct lsv_out *out, long long v);
+
+/* ===============================================
+   Rendering
+   =============================================== */
+typedef void (*lsv_render_fn)(const struct lsv_dir *dir, const struct lsv_options *opts,
+                              struct lsv_out *out);
+
+/* Picks the renderer specialized for opts' mode, format and color once,
+   so callers rendering many directories skip the per-call dispatch */
+lsv_render_fn lsv_render_select(const struct lsv_options *opts);
+
+void lsv_render_dir(const struct lsv_dir *dir, const struct lsv_options *opts,
+                    struct lsv_out *out);
+
+/* --format=binary stream layout (host byte order):
+ *
+ *   struct lsv_bin_header                  once, at the start
+ *   { struct lsv_bin_record, path bytes }  per entry
+ *
+ * The path (directory/name, no terminating NUL) follows its record and
+ * is zero-padded to a multiple of 8 bytes, so every record starts 8-byte
+ * aligned and the stream can be mmap'ed and walked without parsing:
+ *     next = (char *)rec + sizeof(*rec) + LSV_BIN_PAD(rec->name_len)
+ * Entries whose lstat() failed are written too, flagged LSV_BIN_NO_STAT.
+ */
+#define LSV_BIN_MAGIC   0x4256534cU     // "LSVB"
+#define LSV_BIN_VERSION 2
+#define LSV_BIN_PAD(n)  (((size_t)(n) + 7) & ~(size_t)7)
+
+struct lsv_bin_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;   // sizeof(struct lsv_bin_record)
+};
+
+struct lsv_bin_record {
+    uint32_t name_len;
+    uint32_t mode;
+    uint64_t size;
+    int64_t  mtime;         // seconds since the epoch
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t ino;
+    uint32_t flags;         // LSV_BIN_NO_STAT
+    int32_t  stat_errno;    // why lstat() failed, with LSV_BIN_NO_STAT
+};
+
+/* lstat() failed: the stat fields above are zero */
+#define LSV_BIN_NO_STAT 0x1u
+
+void lsv_render_bin_header(struct lsv_out *out);
+
+#endif /* LSV_H */
@@ -0,0 +1,967 @@
+/*
+* Programming Assignment 04: lsv1.7.0
+* Version 1.7.0 - liblsv Library
+* Usage:
+*       $ lsv1.7.0
+*       $ lsv1.7.0 -l
+*       $ lsv1.7.0 -x
+*       $ lsv1.7.0 -R
+*       $ lsv1.7.0 -lR /home
+*       $ lsv1.7.0 -nR /data
+*       $ lsv1.7.0 -lv /artifacts
+*       $ lsv1.7.0 -la ~
+*       $ lsv1.7.0 -AR /etc/skel
+*       $ LC_COLLATE=de_DE.UTF-8 lsv1.7.0 --collate /srv/share
+*       $ lsv1.7.0 -xR /etc/
+*       $ lsv1.7.0 -R --format=jsonl /data
+*       $ lsv1.7.0 --du --top 20 /data
+*       $ lsv1.7.0 --top 100 --by size /data
+*       $ lsv1.7.0 --count -R /data
+*       $ lsv1.7.0 -R --prune .git --exclude '*.o' src
+*       $ lsv1.7.0 -1 --color=never /usr/bin
+*       $ lsv1.7.0 -lR --prefetch 64 /mnt/nfs
+*       $ lsv1.7.0 --daemon &  lsvc -l /etc
+*       $ lsv1.7.0 --snapshot before.lsv /data
+*       $ lsv1.7.0 --diff before.lsv /data --quick
+*       $ lsv1.7.0 --query before.lsv /data/x --size +1G --mtime -1d
+*       $ lsv1.7.0 -lR --checkpoint scan.ckpt /archive >> listing.txt
+*       $ lsv1.7.0 -lR --checkpoint scan.ckpt --resume /archive >> listing.txt
+*       $ lsv1.7.0 -R --nice-io --max-stats 2000 --stats /srv
+*       $ lsv1.7.0 -lR --inode-order /mnt/hdd
+*       $ find /data -maxdepth 3 -type d -print0 | lsv1.7.0 -l --from0 -
+*
+* Feature 8:
+* - Moves directory loading, sorting, rendering and the recursive
+*   walker into liblsv (lib/liblsv.a, lib/liblsv.so)
+* - lsv is now a thin front end: it parses flags and renders each
+*   directory the walker visits
+* - --format=nul|jsonl|binary machine-readable output through the
+*   buffered writer (no headers, colors or terminal width detection)
+* - -s / --du prints per-directory totals (KiB, bytes, entries) summed
+*   bottom-up during the walk; --top N keeps only the N largest
+* - --top N --by size|mtime ranks the largest or newest files of a whole
+*   tree in a bounded heap and prints only the final list
+* - --count prints per-directory and total entry counts using raw
+*   getdents64() and d_type, without any stat() calls
+* - --include/--exclude/--prune PATTERN (glob, or re:REGEX) compiled
+*   once and applied to raw names before any stat() or recursion
+* - -1 lists one name per line; --color=always|auto|never; the renderer
+*   for the chosen mode and color is selected once before the walk
+* - -R loads and stats upcoming directories on a reader thread while the
+*   current one is rendered; --prefetch N bounds the lead (0: serial)
+* - --daemon[=SOCKET] runs as lsvd: requests from bin/lsvc are served
+*   with warm directory, user/group and color caches
+* - --snapshot FILE writes a columnar binary snapshot in tree order;
+*   --diff OLD NEW merges it with another snapshot or the live tree
+*   (--quick reuses the snapshot listing of directories whose mtime is unchanged)
+* - --query FILE [DIR] answers --size/--mtime/--type/--owner/--name
+*   predicates from a snapshot's columns without touching the tree
+* - -R --checkpoint FILE saves the pending directories and the output
+*   offset periodically and on SIGINT/SIGTERM; --resume continues there
+* - --nice-io (idle I/O class, adaptive backoff), --max-dirs/--max-stats N
+*   per second token buckets; --stats reports calls, latency and throttling
+* - --inode-order lstat()s entries and opens subdirectories in ascending
+*   inode order (fewer seeks on cold rotational disks), output unchanged
+* - -n prints numeric uid/gid without ever loading NSS; -g and -o drop
+*   the owner or the group column (each implies -l)
+* - --from-file FILE / --from0 FILE (- for stdin) lists newline- or
+*   NUL-separated paths in one process, in input order
+* - -v sorts by version: digit runs compare by value (build-9 < build-10)
+* - --collate sorts in the locale's strcoll() order from strxfrm() keys
+*   computed once per name
+* - -l shows "name -> target" for symlinks, read with readlinkat() in the
+*   same pass as the lstat()s
+* - --splice hands output buffers to a stdout pipe with vmsplice()
+* - -a lists dotfiles with "." and "..", -A dotfiles only; the choice is
+*   one check on each raw name in the directory reader
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <locale.h>
+#include <pwd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "lsv.h"
+
+#define DAEMON_CACHE_DIRS 4096
+#define CHECKPOINT_INTERVAL 10  // seconds between --checkpoint saves
+
+enum run_mode {
+    RUN_LIST = 0,   // normal listing
+    RUN_DU,         // -s / --du
+    RUN_TOP,        // --top N without --du
+    RUN_COUNT,      // --count
+    RUN_SNAPSHOT,   // --snapshot FILE
+    RUN_DIFF,       // --diff OLD NEW
+    RUN_QUERY       // --query FILE [DIR]
+};
+
+struct frontend {
+    struct lsv_options opts;
+    struct lsv_out *out;
+    struct lsv_du *du;      // -s / --du accumulator
+    struct lsv_top *top;    // --top ranking
+    lsv_render_fn render;   // kernel for opts, chosen once
+    int batch;              // --from-file: print each root's header in visit
+    size_t roots;           // roots visited so far
+};
+
+/* --from-file / --from0: paths separated by newlines or NULs */
+struct path_source {
+    FILE   *f;
+    int     delim;
+    char   *line;
+    size_t  cap;
+};
+
+static volatile sig_atomic_t interrupted;   // --checkpoint: SIGINT or SIGTERM seen
+
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+/* ===============================================
+   Walker Callbacks
+   =============================================== */
+static int visit_dir(const struct lsv_dir *dir, int depth, void *ctx)
+{
+    struct frontend *fe = ctx;
+
+    if (interrupted)
+        return 1;   // not rendered: stays pending in the checkpoint
+    if (depth == 0 && fe->batch) {
+        // Same framing as path operands: "path:", listing, blank line
+        if (fe->roots++ > 0)
+            lsv_out_putc(fe->out, '\n');
+        lsv_out_puts(fe->out, lsv_dir_path(dir));
+        lsv_out_puts(fe->out, ":\n");
+    } else if (depth > 0 && fe->opts.format == LSV_FORMAT_TEXT) {
+        lsv_out_puts(fe->out, "\n");
+        lsv_out_puts(fe->out, lsv_dir_path(dir));
+        lsv_out_puts(fe->out, ":\n");
+    }
+    fe->render(dir, &fe->opts, fe->out);
+    return 0;
+}
+
+static int visit_du(const struct lsv_dir *dir, int depth, void *ctx)
+{
+    struct frontend *fe = ctx;
+    return lsv_du_visit(fe->du, dir, depth);
+}
+
+static void leave_du(const struct lsv_dir *dir, int depth, void *ctx)
+{
+    struct frontend *fe = ctx;
+    lsv_du_leave(fe->du, dir, depth, NULL, fe->out);
+}
+
+static int visit_top(const struct lsv_dir *dir, int depth, void *ctx)
+{
+    struct frontend *fe = ctx;
+    (void)depth;
+    lsv_top_visit(fe->top, dir);
+    return 0;
+}
+
+static void report_error(const char *path, const char *what, int err, void *ctx)
+{
+    struct frontend *fe = ctx;
+
+    lsv_out_flush(fe->out);     // keep stderr ordered with stdout
+    if (strcmp(what, "opendir") == 0) {
+        fprintf(stderr, "Cannot open directory: %s\n", path);
+    } else {
+        errno = err;
+        perror("readdir failed");
+    }
+}
+
+static int parse_format(const char *arg)
+{
+    if (strcmp(arg, "text") == 0) return LSV_FORMAT_TEXT;
+    if (strcmp(arg, "nul") == 0) return LSV_FORMAT_NUL;
+    if (strcmp(arg, "jsonl") == 0) return LSV_FORMAT_JSONL;
+    if (strcmp(arg, "binary") == 0) return LSV_FORMAT_BINARY;
+    return -1;
+}
+
+static int parse_count(const char *arg, size_t *out)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-')
+        return -1;
+    *out = (size_t)v;
+    return 0;
+}
+
+static int parse_color(const char *arg)
+{
+    if (arg == NULL || strcmp(arg, "always") == 0) return 1;
+    if (strcmp(arg, "never") == 0) return 0;
+    if (strcmp(arg, "auto") == 0) return isatty(STDOUT_FILENO);
+    return -1;
+}
+
+/* [+|-]N[K|M|G|T]: more than, less than or exactly N bytes */
+static int parse_size_pred(const char *arg, struct lsv_query *q)
+{
+    static const char units[] = "KMGT";
+    char sign = (arg[0] == '+' || arg[0] == '-') ? *arg++ : 0;
+    char *end;
+
+    errno = 0;
+    uint64_t v = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || arg[0] == '-')
+        return -1;
+    if (*end != '\0') {
+        const char *u = strchr(units, *end);
+        if (u == NULL || end[1] != '\0')
+            return -1;
+        for (const char *p = units; p <= u; p++) {
+            if (v > UINT64_MAX / 1024)
+                return -1;
+            v *= 1024;
+        }
+    }
+
+    if (sign == '+') {
+        if (v == UINT64_MAX)
+            return -1;
+        q->min_size = v + 1;
+    } else if (sign == '-') {
+        if (v == 0)
+            return -1;
+        q->max_size = v - 1;
+    } else {
+        q->min_size = q->max_size = v;
+    }
+    return 0;
+}
+
+/* -N[s|m|h|d]: modified within the last N units; +N: longer ago */
+static int parse_age_pred(const char *arg, struct lsv_query *q)
+{
+    char sign = *arg++;
+    char *end;
+
+    if (sign != '+' && sign != '-')
+        return -1;
+    errno = 0;
+    long long v = strtoll(arg, &end, 10);
+    if (errno != 0 || end == arg || arg[0] == '-' || (*end && end[1] != '\0'))
+        return -1;
+    long long unit = *end == 'm' ? 60 : *end == 'h' ? 3600 :
+                     *end == 'd' || *end == '\0' ? 86400 : *end == 's' ? 1 : 0;
+    if (unit == 0 || v > INT64_MAX / 1000000000 / unit)
+        return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t cut = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec - v * unit * 1000000000;
+    if (sign == '-')
+        q->min_mtime = cut;
+    else
+        q->max_mtime = cut;
+    return 0;
+}
+
+static int parse_type_pred(const char *arg)
+{
+    static const char letters[] = "fdlpsbc";
+    static const int types[] = { S_IFREG, S_IFDIR, S_IFLNK, S_IFIFO, S_IFSOCK, S_IFBLK, S_IFCHR };
+    const char *p = arg[0] && !arg[1] ? strchr(letters, arg[0]) : NULL;
+    return p ? types[p - letters] : -1;
+}
+
+static int64_t parse_owner(const char *arg)
+{
+    struct passwd *pw = getpwnam(arg);
+    if (pw != NULL)
+        return pw->pw_uid;
+
+    char *end;
+    errno = 0;
+    unsigned long uid = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' || uid > UINT32_MAX)
+        return -1;
+    return (int64_t)uid;
+}
+
+/* Returns the next non-empty path, or NULL at the end of the input; the
+   string is reused by the next call */
+static const char *next_path(void *arg)
+{
+    struct path_source *src = arg;
+    ssize_t n;
+
+    while ((n = getdelim(&src->line, &src->cap, src->delim, src->f)) != -1) {
+        if (n > 0 && src->line[n - 1] == src->delim)
+            src->line[--n] = '\0';
+        if (n > 0)
+            return src->line;
+    }
+    return NULL;
+}
+
+static int parse_top_key(const char *arg)
+{
+    if (strcmp(arg, "size") == 0) return LSV_TOP_SIZE;
+    if (strcmp(arg, "mtime") == 0) return LSV_TOP_MTIME;
+    return -1;
+}
+
+enum {
+    OPT_FORMAT = 256,
+    OPT_TOP,
+    OPT_BY,
+    OPT_COUNT,
+    OPT_INCLUDE,
+    OPT_EXCLUDE,
+    OPT_PRUNE,
+    OPT_COLOR,
+    OPT_PREFETCH,
+    OPT_DAEMON,
+    OPT_SNAPSHOT,
+    OPT_DIFF,
+    OPT_QUICK,
+    OPT_QUERY,
+    OPT_SIZE,
+    OPT_MTIME,
+    OPT_TYPE,
+    OPT_OWNER,
+    OPT_NAME,
+    OPT_CHECKPOINT,
+    OPT_RESUME,
+    OPT_NICE_IO,
+    OPT_MAX_DIRS,
+    OPT_MAX_STATS,
+    OPT_STATS,
+    OPT_INODE_ORDER,
+    OPT_FROM_FILE,
+    OPT_FROM0,
+    OPT_COLLATE,
+    OPT_SPLICE
+};
+
+static const struct option long_options[] = {
+    { "format", required_argument, NULL, OPT_FORMAT },
+    { "du",     no_argument,       NULL, 's' },
+    { "top",    required_argument, NULL, OPT_TOP },
+    { "by",     required_argument, NULL, OPT_BY },
+    { "count",  no_argument,       NULL, OPT_COUNT },
+    { "include", required_argument, NULL, OPT_INCLUDE },
+    { "exclude", required_argument, NULL, OPT_EXCLUDE },
+    { "prune",  required_argument, NULL, OPT_PRUNE },
+    { "color",  optional_argument, NULL, OPT_COLOR },
+    { "prefetch", required_argument, NULL, OPT_PREFETCH },
+    { "daemon", optional_argument, NULL, OPT_DAEMON },
+    { "snapshot", required_argument, NULL, OPT_SNAPSHOT },
+    { "diff",   required_argument, NULL, OPT_DIFF },
+    { "quick",  no_argument,       NULL, OPT_QUICK },
+    { "query",  required_argument, NULL, OPT_QUERY },
+    { "size",   required_argument, NULL, OPT_SIZE },
+    { "mtime",  required_argument, NULL, OPT_MTIME },
+    { "type",   required_argument, NULL, OPT_TYPE },
+    { "owner",  required_argument, NULL, OPT_OWNER },
+    { "name",   required_argument, NULL, OPT_NAME },
+    { "checkpoint", required_argument, NULL, OPT_CHECKPOINT },
+    { "resume", no_argument,       NULL, OPT_RESUME },
+    { "nice-io", no_argument,      NULL, OPT_NICE_IO },
+    { "max-dirs", required_argument, NULL, OPT_MAX_DIRS },
+    { "max-stats", required_argument, NULL, OPT_MAX_STATS },
+    { "stats",  no_argument,       NULL, OPT_STATS },
+    { "inode-order", no_argument,  NULL, OPT_INODE_ORDER },
+    { "from-file", required_argument, NULL, OPT_FROM_FILE },
+    { "from0",  required_argument, NULL, OPT_FROM0 },
+    { "collate", no_argument,      NULL, OPT_COLLATE },
+    { "splice", no_argument,       NULL, OPT_SPLICE },
+    { NULL, 0, NULL, 0 }
+};
+
+static int serve(const char *path);
+
+/* --snapshot FILE [DIR] and --diff OLD NEW, where NEW is a snapshot or a
+   directory. Diffs exit like diff(1): 0 same, 1 different, 2 trouble. */
+static int run_snapshot(struct frontend *fe, const struct lsv_walk_ops *ops, int run,
+                        const char *snap_path, int diff_flags, int nargs, char **args)
+{
+    if (run == RUN_SNAPSHOT) {
+        if (nargs > 1) {
+            fprintf(stderr, "--snapshot takes one directory\n");
+            return 2;
+        }
+        if (lsv_snapshot_write(nargs ? args[0] : ".", &fe->opts, ops, fe, snap_path) == -1) {
+            perror(snap_path);
+            return 2;
+        }
+        return 0;
+    }
+
+    if (nargs != 1) {
+        fprintf(stderr, "--diff needs OLD and NEW (snapshot or directory)\n");
+        return 2;
+    }
+    struct lsv_snapshot *old = lsv_snapshot_open(snap_path);
+    if (old == NULL) {
+        perror(snap_path);
+        return 2;
+    }
+
+    long changes;
+    struct stat st;
+    if (stat(args[0], &st) == 0 && S_ISDIR(st.st_mode)) {
+        changes = lsv_diff_tree(old, args[0], &fe->opts, diff_flags, ops, fe, fe->out);
+    } else {
+        struct lsv_snapshot *cur = lsv_snapshot_open(args[0]);
+        if (cur == NULL) {
+            perror(args[0]);
+            lsv_snapshot_close(old);
+            return 2;
+        }
+        changes = lsv_diff_snapshots(old, cur, fe->out);
+        lsv_snapshot_close(cur);
+    }
+    lsv_snapshot_close(old);
+
+    if (changes < 0) {
+        lsv_out_flush(fe->out);
+        fprintf(stderr, "Corrupt snapshot\n");
+        return 2;
+    }
+    return changes > 0;
+}
+
+/* --query FILE [DIR]: exits like grep(1), 0 matches, 1 none, 2 trouble */
+static int run_query(struct frontend *fe, const char *snap_path, struct lsv_query *q,
+                     int nargs, char **args)
+{
+    if (nargs > 1) {
+        fprintf(stderr, "--query takes one directory\n");
+        return 2;
+    }
+    struct lsv_snapshot *snap = lsv_snapshot_open(snap_path);
+    if (snap == NULL) {
+        perror(snap_path);
+        return 2;
+    }
+
+    q->under = nargs ? args[0] : NULL;
+    char terminator = fe->opts.format == LSV_FORMAT_NUL ? '\0' : '\n';
+    long matches = lsv_snapshot_query(snap, q, terminator, fe->out);
+    lsv_snapshot_close(snap);
+    if (matches < 0) {
+        lsv_out_flush(fe->out);
+        if (errno == ENOENT)
+            fprintf(stderr, "Not in snapshot: %s\n", q->under);
+        else
+            fprintf(stderr, "Corrupt snapshot\n");
+        return 2;
+    }
+    return matches == 0;
+}
+
+/* -R --checkpoint FILE [--resume] [DIR]: a serial walk of one directory
+   that can be interrupted and continued */
+static int run_checkpointed(struct frontend *fe, const struct lsv_walk_ops *ops,
+                            const char *cp_path, int resume, int nargs, char **args)
+{
+    if (nargs > 1) {
+        fprintf(stderr, "--checkpoint takes one directory\n");
+        return 2;
+    }
+    const char *root = nargs ? args[0] : ".";
+    int text = fe->opts.format == LSV_FORMAT_TEXT && nargs > 0;
+
+    struct sigaction sa = { .sa_handler = on_interrupt, .sa_flags = SA_RESTART };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (text && !resume) {
+        lsv_out_puts(fe->out, root);
+        lsv_out_puts(fe->out, ":\n");
+    }
+    int rc = lsv_walk_checkpointed(root, &fe->opts, ops, fe, fe->out, cp_path,
+                                   CHECKPOINT_INTERVAL, resume);
+    if (rc == -1) {
+        lsv_out_flush(fe->out);
+        if (errno == EXDEV)
+            fprintf(stderr, "%s: checkpoint of a different directory\n", cp_path);
+        else
+            perror(cp_path);
+        return 1;
+    }
+    if (rc == 1) {
+        fprintf(stderr, "Interrupted; continue with --checkpoint %s --resume\n", cp_path);
+        return 1;
+    }
+    if (text)
+        lsv_out_putc(fe->out, '\n');
+    return 0;
+}
+
+static void print_stats(const struct lsv_throttle *throttle)
+{
+    struct lsv_throttle_stats st;
+    lsv_throttle_stats(throttle, &st);
+    fprintf(stderr, "%llu dirs (%.1f us each), %llu stats (%.1f us each), "
+            "throttled %.2f s, %llu backoffs, lowest speed %.0f%%\n",
+            (unsigned long long)st.dirs, st.dir_us, (unsigned long long)st.stats, st.stat_us,
+            st.waited_sec, (unsigned long long)st.backoffs, st.scale_min * 100);
+}
+
+static int run_lsv(int argc, char *argv[], struct lsv_cache *cache)
+{
+    int opt;
+    int status = 0;
+    const char *daemon_path = NULL;
+    const char *snap_path = NULL;   // --snapshot output or --diff OLD
+    const char *cp_path = NULL;     // --checkpoint
+    int resume = 0;
+    int nice_io = 0, stats = 0, splice = 0;
+    size_t max_dirs = 0, max_stats = 0;
+    int diff_flags = 0;
+    struct lsv_query query;
+    size_t top = 0;
+    int top_by = LSV_TOP_SIZE;
+    int run = RUN_LIST;
+    struct frontend fe = { .du = NULL, .top = NULL };
+    struct lsv_filter *filter = NULL;
+    struct lsv_walk_ops ops = { visit_dir, report_error, NULL };
+    const char *from_path = NULL;   // --from-file / --from0
+    struct path_source from = { .f = NULL };
+
+    lsv_options_init(&fe.opts);
+    lsv_query_init(&query);
+    fe.opts.cache = cache;
+    optind = 0;     // rescan from scratch: lsvd calls this once per request
+
+    // Parse -l, -n, -g, -o, -x, -1, -R, -s, -v, -a, -A and long options
+    while ((opt = getopt_long(argc, argv, "lngox1RsvaA", long_options, NULL)) != -1) {
+        if (opt == 'l') {
+            fe.opts.mode = LSV_MODE_LONG;
+        } else if (opt == 'n' || opt == 'g' || opt == 'o') {
+            // Like ls: each implies -l
+            fe.opts.mode = LSV_MODE_LONG;
+            fe.opts.ids |= opt == 'n' ? LSV_IDS_NUMERIC :
+                           opt == 'g' ? LSV_IDS_NO_OWNER : LSV_IDS_NO_GROUP;
+        } else if (opt == 'x') {
+            if (fe.opts.mode != LSV_MODE_LONG)
+                fe.opts.mode = LSV_MODE_ACROSS;
+        } else if (opt == '1') {
+            if (fe.opts.mode != LSV_MODE_LONG)
+                fe.opts.mode = LSV_MODE_ONE;
+        } else if (opt == OPT_DAEMON) {
+            if (cache != NULL) {
+                fprintf(stderr, "--daemon is not accepted in a request\n");
+                status = 2;
+                goto done;
+            }
+            daemon_path = optarg ? optarg : "";
+        } else if (opt == OPT_COLOR) {
+            fe.opts.color = parse_color(optarg);
+            if (fe.opts.color < 0) {
+                fprintf(stderr, "Unknown value for --color: %s (use always, auto or never)\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == 'R') {
+            fe.opts.recursive = 1;
+        } else if (opt == 's') {
+            run = RUN_DU;
+        } else if (opt == 'v') {
+            fe.opts.sort = LSV_SORT_VERSION;
+        } else if (opt == 'a' || opt == 'A') {
+            // Like ls: the last of the two wins
+            fe.opts.hidden = opt == 'a' ? LSV_HIDDEN_ALL : LSV_HIDDEN_ALMOST;
+        } else if (opt == OPT_TOP) {
+            if (parse_count(optarg, &top) == -1 || top == 0) {
+                fprintf(stderr, "Invalid count for --top: %s\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_PREFETCH) {
+            size_t depth;
+            if (parse_count(optarg, &depth) == -1 || depth > 4096) {
+                fprintf(stderr, "Invalid depth for --prefetch: %s\n", optarg);
+                status = 2;
+                goto done;
+            }
+            fe.opts.prefetch = (int)depth;
+        } else if (opt == OPT_INCLUDE || opt == OPT_EXCLUDE || opt == OPT_PRUNE) {
+            int kind = opt == OPT_INCLUDE ? LSV_FILTER_INCLUDE :
+                       opt == OPT_EXCLUDE ? LSV_FILTER_EXCLUDE : LSV_FILTER_PRUNE;
+            if (filter == NULL && (filter = lsv_filter_new()) == NULL) {
+                perror("lsv_filter_new");
+                status = 1;
+                goto done;
+            }
+            if (lsv_filter_add(filter, kind, optarg) == -1) {
+                fprintf(stderr, "Invalid pattern: %s\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_COUNT) {
+            run = RUN_COUNT;
+        } else if (opt == OPT_SNAPSHOT || opt == OPT_DIFF) {
+            run = opt == OPT_SNAPSHOT ? RUN_SNAPSHOT : RUN_DIFF;
+            snap_path = optarg;
+        } else if (opt == OPT_QUICK) {
+            diff_flags |= LSV_DIFF_QUICK;
+        } else if (opt == OPT_CHECKPOINT) {
+            if (cache != NULL) {
+                fprintf(stderr, "--checkpoint is not accepted in a request\n");
+                status = 2;
+                goto done;
+            }
+            cp_path = optarg;
+        } else if (opt == OPT_RESUME) {
+            resume = 1;
+        } else if (opt == OPT_NICE_IO) {
+            if (cache != NULL) {
+                fprintf(stderr, "--nice-io is not accepted in a request\n");
+                status = 2;
+                goto done;
+            }
+            nice_io = 1;
+        } else if (opt == OPT_MAX_DIRS || opt == OPT_MAX_STATS) {
+            if (parse_count(optarg, opt == OPT_MAX_DIRS ? &max_dirs : &max_stats) == -1) {
+                fprintf(stderr, "Invalid rate for --%s: %s\n",
+                        opt == OPT_MAX_DIRS ? "max-dirs" : "max-stats", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_STATS) {
+            stats = 1;
+        } else if (opt == OPT_INODE_ORDER) {
+            fe.opts.inode_order = 1;
+        } else if (opt == OPT_SPLICE) {
+            splice = 1;
+        } else if (opt == OPT_QUERY) {
+            run = RUN_QUERY;
+            snap_path = optarg;
+        } else if (opt == OPT_SIZE || opt == OPT_MTIME) {
+            if ((opt == OPT_SIZE ? parse_size_pred(optarg, &query) :
+                                   parse_age_pred(optarg, &query)) == -1) {
+                fprintf(stderr, "Invalid value for --%s: %s\n",
+                        opt == OPT_SIZE ? "size" : "mtime", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_TYPE) {
+            int type = parse_type_pred(optarg);
+            if (type < 0) {
+                fprintf(stderr, "Unknown type: %s (use f, d, l, p, s, b or c)\n", optarg);
+                status = 2;
+                goto done;
+            }
+            query.type = (uint32_t)type;
+        } else if (opt == OPT_OWNER) {
+            query.uid = parse_owner(optarg);
+            if (query.uid < 0) {
+                fprintf(stderr, "Unknown user: %s\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_NAME) {
+            query.name = optarg;
+        } else if (opt == OPT_BY) {
+            top_by = parse_top_key(optarg);
+            if (top_by < 0) {
+                fprintf(stderr, "Unknown key for --by: %s (use size or mtime)\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else if (opt == OPT_COLLATE) {
+            fe.opts.sort = LSV_SORT_COLLATE;
+        } else if (opt == OPT_FROM_FILE || opt == OPT_FROM0) {
+            from_path = optarg;
+            from.delim = opt == OPT_FROM0 ? '\0' : '\n';
+        } else if (opt == OPT_FORMAT) {
+            fe.opts.format = parse_format(optarg);
+            if (fe.opts.format < 0) {
+                fprintf(stderr, "Unknown format: %s (use text, nul, jsonl or binary)\n", optarg);
+                status = 2;
+                goto done;
+            }
+        } else {
+            status = 2;
+            goto done;
+        }
+    }
+
+    if ((cp_path != NULL || resume) &&
+        (cp_path == NULL || !fe.opts.recursive || run != RUN_LIST || top > 0)) {
+        fprintf(stderr, "--checkpoint FILE needs a plain -R listing; --resume needs --checkpoint\n");
+        status = 2;
+        goto done;
+    }
+
+    if (from_path != NULL &&
+        (optind < argc || cp_path != NULL || run == RUN_SNAPSHOT || run == RUN_DIFF || run == RUN_QUERY)) {
+        fprintf(stderr, "--from-file/--from0 take the place of path operands and cannot be "
+                        "used with --snapshot, --diff, --query or --checkpoint\n");
+        status = 2;
+        goto done;
+    }
+    if (from_path != NULL && cache != NULL && strcmp(from_path, "-") == 0) {
+        fprintf(stderr, "--from-file - is not accepted in a request (stdin is not forwarded)\n");
+        status = 2;
+        goto done;
+    }
+
+    if (daemon_path != NULL) {
+        lsv_filter_free(filter);
+        return serve(*daemon_path ? daemon_path : NULL);
+    }
+
+    if (filter != NULL) {
+        if (lsv_filter_compile(filter) == -1) {
+            perror("lsv_filter_compile");
+            status = 2;
+            goto done;
+        }
+        fe.opts.filter = filter;
+    }
+
+    if (from_path != NULL) {
+        from.f = strcmp(from_path, "-") == 0 ? stdin : fopen(from_path, "re");
+        if (from.f == NULL) {
+            fprintf(stderr, "Cannot open %s: ", from_path);
+            perror(NULL);
+            status = 2;
+            goto done;
+        }
+    }
+
+    // Only --collate loads a locale; every other order is byte based
+    if (fe.opts.sort == LSV_SORT_COLLATE && setlocale(LC_COLLATE, "") == NULL)
+        fprintf(stderr, "Cannot load the collation locale, sorting in C order\n");
+
+    if (nice_io && lsv_nice_io() == -1)
+        perror("ioprio_set");   // still run, just without the idle class
+    if (nice_io || stats || max_dirs > 0 || max_stats > 0) {
+        fe.opts.throttle = lsv_throttle_new((double)max_dirs, (double)max_stats, nice_io);
+        if (fe.opts.throttle == NULL) {
+            perror("lsv_throttle_new");
+            status = 1;
+            goto done;
+        }
+    }
+
+    fe.out = lsv_out_open(STDOUT_FILENO);
+    if (fe.out == NULL) {
+        perror("lsv_out_open");
+        status = 1;
+        goto done;
+    }
+    if (splice)
+        lsv_out_splice(fe.out);
+    if (run == RUN_LIST && top > 0)
+        run = RUN_TOP;
+
+    if (run == RUN_DU) {
+        // Totals need the whole tree; the listing renderers are not used
+        fe.opts.recursive = 1;
+        fe.opts.need_stat = 1;
+        fe.du = lsv_du_new(top);
+        if (fe.du == NULL) {
+            perror("lsv_du_new");
+            status = 1;
+            goto done;
+        }
+        ops.visit = visit_du;
+        ops.leave = leave_du;
+    } else if (run == RUN_TOP) {
+        fe.opts.recursive = 1;
+        fe.opts.need_stat = 1;
+        fe.opts.color = 0;
+        fe.top = lsv_top_new(top, top_by);
+        if (fe.top == NULL) {
+            perror("lsv_top_new");
+            status = 1;
+            goto done;
+        }
+        ops.visit = visit_top;
+    } else if (fe.opts.format == LSV_FORMAT_BINARY) {
+        lsv_render_bin_header(fe.out);
+    }
+    fe.render = lsv_render_select(&fe.opts);
+
+    if (run == RUN_COUNT) {
+        uint64_t total = 0;
+        if (from.f != NULL) {
+            for (const char *path; (path = next_path(&from)) != NULL; )
+                total += lsv_count(path, &fe.opts, &ops, &fe, fe.out);
+            if (ferror(from.f)) {
+                perror(from_path);
+                status = 1;
+            }
+        } else if (optind == argc) {
+            total += lsv_count(".", &fe.opts, &ops, &fe, fe.out);
+        }
+        for (int i = optind; i < argc; i++)
+            total += lsv_count(argv[i], &fe.opts, &ops, &fe, fe.out);
+        lsv_out_u64(fe.out, total);
+        lsv_out_puts(fe.out, "\ttotal\n");
+        if (lsv_out_close(fe.out) == -1)
+            status = 1;
+        fe.out = NULL;
+        goto done;
+    }
+
+    if (run == RUN_SNAPSHOT || run == RUN_DIFF || run == RUN_QUERY) {
+        if (run == RUN_QUERY)
+            status = run_query(&fe, snap_path, &query, argc - optind, argv + optind);
+        else
+            status = run_snapshot(&fe, &ops, run, snap_path, diff_flags, argc - optind, argv + optind);
+        if (lsv_out_close(fe.out) == -1 && status != 2) {
+            perror("write failed");
+            status = 2;
+        }
+        fe.out = NULL;
+        goto done;
+    }
+
+    int text = fe.opts.format == LSV_FORMAT_TEXT && run == RUN_LIST;
+    if (cp_path != NULL) {
+        status = run_checkpointed(&fe, &ops, cp_path, resume, argc - optind, argv + optind);
+    } else if (from.f != NULL) {
+        // One process for the whole list: caches stay warm and the reader
+        // loads the next paths while earlier ones are rendered
+        fe.batch = text;
+        lsv_walk_many(next_path, &from, &fe.opts, &ops, &fe);
+        if (fe.roots > 0)
+            lsv_out_putc(fe.out, '\n');
+        if (ferror(from.f)) {
+            perror(from_path);
+            status = 1;
+        }
+    } else if (optind == argc) {
+        // No directories given, use current directory
+        lsv_walk(".", &fe.opts, &ops, &fe);
+    } else {
+        // Directories provided
+        for (int i = optind; i < argc; i++) {
+            if (text) {
+                lsv_out_puts(fe.out, argv[i]);
+                lsv_out_puts(fe.out, ":\n");
+            }
+            lsv_walk(argv[i], &fe.opts, &ops, &fe);
+            if (text)
+                lsv_out_putc(fe.out, '\n');
+        }
+    }
+
+    if (fe.du != NULL)
+        lsv_du_finish(fe.du, fe.out);
+    if (fe.top != NULL)
+        lsv_top_finish(fe.top, fe.out);
+
+    if (lsv_out_close(fe.out) == -1) {
+        perror("write failed");
+        status = 1;
+    }
+    fe.out = NULL;
+
+done:
+    if (stats && fe.opts.throttle != NULL) {
+        if (fe.out != NULL)
+            lsv_out_flush(fe.out);
+        print_stats(fe.opts.throttle);
+    }
+    lsv_throttle_free(fe.opts.throttle);
+    lsv_du_free(fe.du);
+    lsv_top_free(fe.top);
+    lsv_filter_free(filter);
+    lsv_out_close(fe.out);
+    if (from.f != NULL && from.f != stdin)
+        fclose(from.f);
+    free(from.line);
+    return status;
+}
+
+/* ===============================================
+   Daemon Mode (--daemon, "lsvd")
+   =============================================== */
+static void set_env(const char *name, const char *value)
+{
+    if (value != NULL)
+        setenv(name, value, 1);
+    else
+        unsetenv(name);
+}
+
+static int serve(const char *path)
+{
+    char default_path[256];
+    if (path == NULL) {
+        if (lsv_daemon_path(default_path, sizeof(default_path)) == -1) {
+            perror("lsvd: socket path");
+            return 1;
+        }
+        path = default_path;
+    }
+
+    int listen_fd = lsv_daemon_listen(path);
+    if (listen_fd == -1) {
+        fprintf(stderr, "lsvd: cannot listen on %s: ", path);
+        perror(NULL);
+        return 1;
+    }
+    struct lsv_cache *cache = lsv_cache_new(DAEMON_CACHE_DIRS);
+    int home = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    int saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (cache == NULL || home == -1 || saved_out == -1 || saved_err == -1) {
+        perror("lsvd");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);  // a client closing its pipe must not end the daemon
+
+    struct lsv_request req;
+    while (lsv_daemon_accept(listen_fd, &req) == 0) {
+        // Run the request as if started by the client: its cwd, its
+        // stdout/stderr, its LS_COLORS and collation locale; caches stay
+        // warm in between. Requests run one at a time, in arrival order.
+        lsv_cache_sync(cache);
+        int status = 2;
+        if (fchdir(req.cwd) == 0 && dup2(req.out, STDOUT_FILENO) != -1 &&
+            dup2(req.err, STDERR_FILENO) != -1) {
+            set_env("LS_COLORS", req.ls_colors);
+            set_env("LC_ALL", req.lc_all);
+            set_env("LC_COLLATE", req.lc_collate);
+            set_env("LANG", req.lang);
+            status = run_lsv(req.argc, req.argv, cache);
+        }
+        setlocale(LC_COLLATE, "C");     // --collate must not outlive its request
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+        if (fchdir(home) == -1)
+            perror("lsvd: fchdir");
+        lsv_daemon_reply(&req, status);
+    }
+    perror("lsvd: accept");
+    lsv_cache_free(cache);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    return run_lsv(argc, argv, NULL);
+}
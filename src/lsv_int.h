@@ -0,0 +1,239 @@
+/*
+* liblsv internal definitions
+* Shared between the library translation units; not part of the public API.
+*/
+
+#ifndef LSV_INT_H
+#define LSV_INT_H
+
+#include <stdint.h>
+
+#include "lsv.h"
+
+/* Entry table, structure-of-arrays layout. Entry i's name is
+   names + name_off[i]; all names live back to back in one blob, in
+   sorted order once lsv_dir_load() returns. Stat columns are NULL
+   unless the load stat'ed entries. Symlink targets read for -l sit in
+   the same blob, each right after its link's name. */
+enum {
+    ENTRY_HAS_STAT = 1 << 0,
+    ENTRY_PRUNE    = 1 << 1,    // matched --prune: listed, never descended
+};
+
+struct lsv_dir {
+    char     *path;
+    size_t    count;
+    size_t    cap;
+
+    char     *names;
+    size_t    names_len;
+    size_t    names_cap;
+    uint32_t *name_off;
+    uint16_t *name_len;
+    uint16_t *width;        // terminal cells, see width.c
+    uint8_t  *type;         // DT_* from readdir()
+    uint8_t  *flags;        // ENTRY_* bits
+
+    uint32_t *mode;
+    uint32_t *nlink;
+    uint32_t *uid;
+    uint32_t *gid;
+    int64_t  *size;
+    int64_t  *mtime;
+    uint32_t *mtime_nsec;
+    int64_t  *blocks;
+    uint64_t *ino;
+    int      *stat_err;     // lstat() errno, reported by -l
+    uint32_t *link_off;     // symlink target in names, LINK_NONE if not a link
+                            // (NULL unless the load read targets)
+
+    int         read_errno;
+    int         has_self;   // self is valid (stat'ed loads only)
+    struct stat self;       // fstat() of the directory itself
+    int         visited;    // walk.c: ops->visit ran for this dir
+    struct cache_entry *entry;  // cache.c: owning entry, NULL if uncached
+};
+
+#define LINK_NONE UINT32_MAX
+
+static inline int is_dot_or_dotdot(const char *name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+/* Hidden-name stage of the directory readers (-a, -A). Names not
+   starting with '.' pass on the first byte, so without either flag
+   it costs the one compare the hardcoded skip did. */
+static inline int hidden_skip(const char *name, int hidden)
+{
+    if (name[0] != '.')
+        return 0;
+    return hidden == LSV_HIDDEN_NONE || (hidden == LSV_HIDDEN_ALMOST && is_dot_or_dotdot(name));
+}
+
+static inline const char *dir_name(const struct lsv_dir *d, size_t i)
+{
+    return d->names + d->name_off[i];
+}
+
+/* Symlink target of entry i, NULL if none was read */
+static inline const char *dir_link(const struct lsv_dir *d, size_t i)
+{
+    return d->link_off && d->link_off[i] != LINK_NONE ? d->names + d->link_off[i] : NULL;
+}
+
+/* Cached display width; byte length if widths were not computed */
+static inline unsigned dir_width(const struct lsv_dir *d, size_t i)
+{
+    return d->width ? d->width[i] : d->name_len[i];
+}
+
+static inline int dir_has_stat(const struct lsv_dir *d, size_t i)
+{
+    return d->flags[i] & ENTRY_HAS_STAT;
+}
+
+struct lsv_out {
+    int    fd;
+    char  *buf;
+    size_t len;
+    size_t cap;
+    size_t written;   // bytes already passed to write()
+    int    err;       // first write() errno, sticky
+    int    want_splice;   // lsv_out_splice(): use vmsplice() if fd is a pipe
+    int    splice;    // fd is a pipe: buffers are handed over with vmsplice()
+    int    mapped;    // buf came from mmap()
+    int    width;     // terminal columns of fd, 0: not asked yet
+};
+
+/* strmap.c: string-keyed open addressing hash map */
+struct strmap_slot {
+    const char *key;    // owned copy, NULL for an empty slot
+    size_t      len;
+    uint64_t    hash;
+    void       *value;
+};
+
+struct strmap {
+    struct strmap_slot *slots;
+    size_t              cap;    // power of two
+    size_t              count;
+};
+
+uint64_t strmap_hash(const char *key, size_t len);
+const struct strmap_slot *strmap_find(const struct strmap *m, const char *key, size_t len);
+struct strmap_slot *strmap_put(struct strmap *m, const char *key, size_t len, void *value);
+void strmap_remove(struct strmap *m, const char *key, size_t len);
+void strmap_free(struct strmap *m, void (*free_value)(void *));
+
+/* width.c */
+unsigned display_width(const char *name, size_t len);
+
+/* colors.c */
+enum color_kind {
+    COLOR_FILE = 0,
+    COLOR_DIR,
+    COLOR_LINK,
+    COLOR_FIFO,
+    COLOR_SOCK,
+    COLOR_BLK,
+    COLOR_CHR,
+    COLOR_EXEC,
+    COLOR_SETUID,
+    COLOR_SETGID,
+    COLOR_STICKY,
+    COLOR_OTHER_WRITABLE,
+    COLOR_STICKY_OTHER_WRITABLE,
+    COLOR_NORMAL,       // "no": any name whose own kind is unset
+    COLOR_KINDS
+};
+
+struct color_seq {
+    char  *seq;     // complete escape sequence, NULL when unset
+    size_t len;
+};
+
+#define MAX_ODD_SUFFIX_LENS 16
+
+struct lsv_colors {
+    struct color_seq kind[COLOR_KINDS];
+    struct color_seq reset;
+    struct strmap    ext;       // case-folded "*suffix" text -> struct color_seq *
+    size_t           odd_lens[MAX_ODD_SUFFIX_LENS];     // suffixes that are not a plain ".ext"
+    size_t           nodd;
+};
+
+const struct color_seq *colors_lookup(const struct lsv_colors *c, const char *name,
+                                      size_t len, mode_t mode);
+
+/* filter.c */
+enum {
+    FILTER_KEEP = 0,
+    FILTER_DROP,
+    FILTER_PRUNE
+};
+
+int filter_check(const struct lsv_filter *f, int dirfd, const char *name, unsigned char type);
+
+/* topn.c: bounded min-heap keeping the N largest keys */
+#define TOPN_VALS 3
+
+struct topn_item {
+    uint64_t key;
+    uint64_t val[TOPN_VALS];    // caller-defined payload
+    char    *label;
+};
+
+struct topn {
+    struct topn_item *items;
+    size_t            count;
+    size_t            cap;
+};
+
+int topn_init(struct topn *t, size_t cap);
+void topn_free(struct topn *t);
+int topn_offer(struct topn *t, uint64_t key, const uint64_t val[TOPN_VALS],
+               const char *label, size_t label_len);
+
+/* Cheap pre-check so callers can skip building a label that would be dropped */
+static inline int topn_accepts(const struct topn *t, uint64_t key)
+{
+    return t->count < t->cap || (t->cap > 0 && key > t->items[0].key);
+}
+void topn_sort(struct topn *t);
+
+/* liblsv.c */
+int lsv_needs_stat(const struct lsv_options *opts);
+int lsv_needs_links(const struct lsv_options *opts);
+
+/* walk.c */
+char *join_path(const char *dir, const char *name);
+
+/* throttle.c: optional pacing around the loader's system calls */
+enum { THROTTLE_DIR, THROTTLE_STAT, THROTTLE_KINDS };
+#define THROTTLE_BATCH 64   // lstat() calls per token request
+uint64_t throttle_begin(struct lsv_throttle *t, int kind, size_t n);
+void throttle_end(struct lsv_throttle *t, int kind, size_t n, size_t units, uint64_t start);
+
+/* cache.c */
+struct lsv_dir *cache_get(struct lsv_cache *c, const char *path, const struct lsv_options *opts);
+void cache_put(struct lsv_dir *d);
+
+/* ids.c */
+const char *user_name(uint32_t uid);
+const char *group_name(uint32_t gid);
+void ids_revalidate(void);
+
+/* render.c */
+void print_colored(struct lsv_out *out, const struct lsv_colors *colors,
+                   const char *name, size_t len, mode_t st_mode);
+
+/* format.c: machine-format kernels for lsv_render_select() */
+void render_nul(const struct lsv_dir *dir, const struct lsv_options *opts,
+                struct lsv_out *out);
+void render_jsonl(const struct lsv_dir *dir, const struct lsv_options *opts,
+                  struct lsv_out *out);
+void render_binary(const struct lsv_dir *dir, const struct lsv_options *opts,
+                   struct lsv_out *out);
+
+#endif /* LSV_INT_H */
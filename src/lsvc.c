@@ -0,0 +1,33 @@
+/*
+* lsvc: client for a running lsvd (lsv1.7.0 --daemon)
+* Usage:
+*       $ lsvc -l /etc
+*       $ LSVD_SOCKET=/run/lsvd.sock lsvc -R --format=jsonl /data
+*
+* Takes the same flags as lsv. The daemon writes the listing directly to
+* this process's stdout and stderr and returns lsv's exit status, so the
+* client's only cost is one connect and one message.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+
+#include "lsv.h"
+
+int main(int argc, char *argv[])
+{
+    char path[256];
+
+    if (lsv_daemon_path(path, sizeof(path)) == -1) {
+        perror("lsvc: socket path");
+        return 1;
+    }
+    int status = lsv_daemon_call(path, argc, argv);
+    if (status < 0) {
+        fprintf(stderr, "lsvc: cannot reach lsvd at %s: ", path);
+        perror(NULL);
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,245 @@
+/*
+* liblsv: buffered output writer
+*
+* All renderers append to a fixed buffer that is handed to write(2) only
+* when full or explicitly flushed, so a listing costs a handful of
+* syscalls instead of one stdio call per name and padding space.
+*
+* After lsv_out_splice(), a pipe gets a page-aligned mmap() buffer and
+* each flush passes it to vmsplice(2) instead of copying it with write().
+* The kernel keeps referencing the spliced pages until the reader consumes
+* them, so a spliced buffer is never written again: it is unmapped and a
+* fresh one is mapped. Whole-page buffers are passed with SPLICE_F_GIFT.
+* If vmsplice() is not usable the writer falls back to write() for good.
+* This is opt-in: remapping and faulting in a buffer per flush cost about
+* what the saved copy does unless the reader splices too, and the caller's
+* pipe is enlarged. Without it, pipes are written like any other fd.
+*
+* Nothing is allocated, mapped or asked of the fd until the first byte
+* is written, so a run that prints nothing (an empty directory) costs no
+* buffer setup at all.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "lsv_int.h"
+
+#define OUT_BUF_SIZE    (64 * 1024)
+#define SPLICE_BUF_SIZE (256 * 1024)
+#define PIPE_SIZE       (1024 * 1024)
+
+static char *map_buffer(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void free_buffer(struct lsv_out *out)
+{
+    if (out->mapped)
+        munmap(out->buf, out->cap);
+    else
+        free(out->buf);
+}
+
+struct lsv_out *lsv_out_open(int fd)
+{
+    struct lsv_out *out = calloc(1, sizeof(*out));
+    if (out == NULL)
+        return NULL;
+    out->fd = fd;
+    return out;
+}
+
+/* Asks for vmsplice() output if the fd turns out to be a pipe. Only
+   takes effect before the first write. */
+void lsv_out_splice(struct lsv_out *out)
+{
+    out->want_splice = 1;
+}
+
+/* Sets up the buffer on first use; without memory, cap stays 0 and
+   every write goes straight to the fd */
+static void attach_buffer(struct lsv_out *out)
+{
+    struct stat st;
+    if (out->want_splice && fstat(out->fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        out->buf = map_buffer(SPLICE_BUF_SIZE);
+        if (out->buf != NULL) {
+            out->splice = 1;
+            out->mapped = 1;
+            out->cap = SPLICE_BUF_SIZE;
+            // A bigger pipe takes several buffers before the reader must run
+            fcntl(out->fd, F_SETPIPE_SZ, PIPE_SIZE);
+        }
+    }
+    if (out->buf == NULL && (out->buf = malloc(OUT_BUF_SIZE)) != NULL)
+        out->cap = OUT_BUF_SIZE;
+}
+
+static int write_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Splices out->buf into the pipe and maps a fresh buffer. Returns 1 if
+   vmsplice() is unavailable for this fd and nothing was written. */
+static int splice_buffer(struct lsv_out *out)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned flags = out->len % (size_t)page == 0 ? SPLICE_F_GIFT : 0;
+    struct iovec iov = { out->buf, out->len };
+
+    while (iov.iov_len > 0) {
+        ssize_t n = vmsplice(out->fd, &iov, 1, flags);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (iov.iov_len == out->len && (errno == EINVAL || errno == ENOSYS))
+                return 1;
+            out->err = errno;
+            break;
+        }
+        iov.iov_base = (char *)iov.iov_base + n;
+        iov.iov_len -= (size_t)n;
+    }
+
+    // The pipe may still reference these pages: never reuse them
+    char *fresh = map_buffer(out->cap);
+    if (fresh == NULL) {
+        // Out of mappings: copy through a heap buffer from now on
+        fresh = malloc(OUT_BUF_SIZE);
+        if (fresh == NULL) {
+            if (!out->err)
+                out->err = ENOMEM;
+            return 0;
+        }
+        munmap(out->buf, out->cap);
+        out->splice = 0;
+        out->mapped = 0;
+        out->buf = fresh;
+        out->cap = OUT_BUF_SIZE;
+        return 0;
+    }
+    munmap(out->buf, out->cap);
+    out->buf = fresh;
+    return 0;
+}
+
+int lsv_out_flush(struct lsv_out *out)
+{
+    if (out->err) {
+        out->len = 0;
+        errno = out->err;
+        return -1;
+    }
+    if (out->len > 0 && out->splice && splice_buffer(out) == 1)
+        out->splice = 0;    // copy from now on; the unspliced buffer is reusable
+    if (out->len > 0 && !out->splice && write_all(out->fd, out->buf, out->len) == -1)
+        out->err = errno;
+    out->written += out->len;
+    out->len = 0;
+    if (out->err) {
+        errno = out->err;
+        return -1;
+    }
+    return 0;
+}
+
+int lsv_out_close(struct lsv_out *out)
+{
+    if (out == NULL)
+        return 0;
+
+    int rc = lsv_out_flush(out);
+    int saved = errno;
+    free_buffer(out);
+    free(out);
+    errno = saved;
+    return rc;
+}
+
+void lsv_out_write(struct lsv_out *out, const void *data, size_t n)
+{
+    if (out->len + n > out->cap) {
+        if (out->buf == NULL)
+            attach_buffer(out);     // first output: nothing to flush yet
+        else
+            lsv_out_flush(out);
+        if (n > out->cap) {
+            // Larger than the whole buffer: bypass it
+            if (!out->err && write_all(out->fd, data, n) == -1)
+                out->err = errno;
+            out->written += n;
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, n);
+    out->len += n;
+}
+
+void lsv_out_puts(struct lsv_out *out, const char *s)
+{
+    lsv_out_write(out, s, strlen(s));
+}
+
+void lsv_out_putc(struct lsv_out *out, char c)
+{
+    if (out->len == out->cap) {
+        lsv_out_write(out, &c, 1);
+        return;
+    }
+    out->buf[out->len++] = c;
+}
+
+void lsv_out_pad(struct lsv_out *out, int n)
+{
+    static const char spaces[] = "                                ";
+
+    while (n > 0) {
+        int chunk = n < (int)sizeof(spaces) - 1 ? n : (int)sizeof(spaces) - 1;
+        lsv_out_write(out, spaces, (size_t)chunk);
+        n -= chunk;
+    }
+}
+
+void lsv_out_u64(struct lsv_out *out, unsigned long long v)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    lsv_out_write(out, p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+void lsv_out_i64(struct lsv_out *out, long long v)
+{
+    if (v < 0) {
+        lsv_out_putc(out, '-');
+        lsv_out_u64(out, 0ULL - (unsigned long long)v);
+    } else {
+        lsv_out_u64(out, (unsigned long long)v);
+    }
+}
@@ -0,0 +1,325 @@
+/*
+* liblsv: renderers for a loaded directory
+*
+* Column (down then across), horizontal (-x), long (-l) and one-per-line
+* (-1) output, with filenames colorized from the LS_COLORS tables in
+* colors.c. Works on the entry table built by lsv_dir_load(), so no file
+* is stat'ed twice. Output goes through the buffered writer in output.c.
+*
+* Every layout is instantiated twice, with and without color, and
+* lsv_render_select() picks one kernel up front: the per-entry loops
+* carry no checks for mode, format or color. The long listing has a
+* second pair for -n that formats uid and gid as numbers and never
+* calls into NSS.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h> // For terminal width
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+#define MAX_ID_NAME 64     // longer user and group names are cut in -l
+
+/* ===============================================
+   Helper Function: Print filename with color
+   =============================================== */
+void print_colored(struct lsv_out *out, const struct lsv_colors *colors,
+                   const char *name, size_t len, mode_t st_mode)
+{
+    const struct color_seq *seq = colors ? colors_lookup(colors, name, len, st_mode) : NULL;
+
+    if (seq == NULL) {
+        lsv_out_write(out, name, len);
+        return;
+    }
+    lsv_out_write(out, seq->seq, seq->len);
+    lsv_out_write(out, name, len);
+    lsv_out_write(out, colors->reset.seq, colors->reset.len);
+}
+
+/* Inlined into every kernel: with colors == NULL (the plain variants)
+   the color branch folds away at compile time */
+static inline __attribute__((always_inline))
+void print_name(struct lsv_out *out, const struct lsv_dir *dir, size_t i,
+                const struct lsv_colors *colors)
+{
+    if (colors != NULL && dir_has_stat(dir, i))
+        print_colored(out, colors, dir_name(dir, i), dir->name_len[i], dir->mode[i]);
+    else
+        lsv_out_write(out, dir_name(dir, i), dir->name_len[i]);
+}
+
+/* Asked once per output, and only by the column layouts */
+static int terminal_width(struct lsv_out *out)
+{
+    if (out->width == 0) {
+        struct winsize w;
+        out->width = 80;    // fallback
+        if (ioctl(out->fd, TIOCGWINSZ, &w) == 0 && w.ws_col > 0)
+            out->width = w.ws_col;
+    }
+    return out->width;
+}
+
+static int max_name_width(const struct lsv_dir *dir)
+{
+    unsigned max_width = 0;
+    for (size_t i = 0; i < dir->count; i++) {
+        unsigned w = dir_width(dir, i);
+        if (w > max_width)
+            max_width = w;
+    }
+    return (int)max_width;
+}
+
+/* ===============================================
+   Default Down-then-Across Display
+   =============================================== */
+static inline __attribute__((always_inline))
+void print_in_columns(const struct lsv_dir *dir, const struct lsv_colors *colors,
+                      struct lsv_out *out)
+{
+    int count = (int)dir->count;
+    int spacing = 2;
+    int col_width = max_name_width(dir) + spacing;
+    int columns = terminal_width(out) / col_width;
+    if (columns < 1)
+        columns = 1;
+
+    int rows = (count + columns - 1) / columns;
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            int idx = c * rows + r;
+            if (idx < count) {
+                print_name(out, dir, (size_t)idx, colors);
+                lsv_out_pad(out, col_width - (int)dir_width(dir, (size_t)idx));
+            }
+        }
+        lsv_out_putc(out, '\n');
+    }
+}
+
+/* ===============================================
+   Horizontal (Left-to-Right) Display (-x)
+   =============================================== */
+static inline __attribute__((always_inline))
+void print_in_columns_horizontal(const struct lsv_dir *dir, const struct lsv_colors *colors,
+                                 struct lsv_out *out)
+{
+    int spacing = 2;
+    int col_width = max_name_width(dir) + spacing;
+    int width = terminal_width(out);
+    int current_width = 0;
+
+    for (size_t i = 0; i < dir->count; i++) {
+        print_name(out, dir, i, colors);
+
+        int next_width = current_width + col_width;
+        if (next_width > width) {
+            lsv_out_putc(out, '\n');
+            current_width = 0;
+        } else {
+            lsv_out_pad(out, col_width - (int)dir_width(dir, i));
+            current_width += col_width;
+        }
+    }
+    lsv_out_putc(out, '\n');
+}
+
+/* ===============================================
+   Long Listing Mode (-l)
+   =============================================== */
+static char *put_u32(char *p, uint32_t v)
+{
+    char tmp[10];
+    char *q = tmp + sizeof(tmp);
+
+    do {
+        *--q = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    memcpy(p, q, (size_t)(tmp + sizeof(tmp) - q));
+    return p + (tmp + sizeof(tmp) - q);
+}
+
+static char *put_id_name(char *p, const char *name)
+{
+    size_t n = strnlen(name, MAX_ID_NAME);
+    memcpy(p, name, n);
+    return p + n;
+}
+
+/* Owner and group columns. numeric is a constant in every kernel, so
+   the -n kernels contain no NSS calls at all. */
+static inline __attribute__((always_inline))
+char *put_ids(char *p, const struct lsv_dir *dir, size_t i, int ids, int numeric)
+{
+    if (!(ids & LSV_IDS_NO_OWNER)) {
+        p = numeric ? put_u32(p, dir->uid[i]) : put_id_name(p, user_name(dir->uid[i]));
+        *p++ = ' ';
+    }
+    if (!(ids & LSV_IDS_NO_GROUP)) {
+        p = numeric ? put_u32(p, dir->gid[i]) : put_id_name(p, group_name(dir->gid[i]));
+        *p++ = ' ';
+    }
+    return p;
+}
+
+static inline __attribute__((always_inline))
+void print_long(const struct lsv_dir *dir, const struct lsv_colors *colors,
+                int ids, int numeric, struct lsv_out *out)
+{
+    for (size_t i = 0; i < dir->count; i++) {
+        if (!dir_has_stat(dir, i)) {
+            lsv_out_flush(out);     // keep stderr ordered with stdout
+            errno = dir->stat_err ? dir->stat_err[i] : ENOMEM;
+            perror("lstat failed");
+            continue;
+        }
+        mode_t mode = dir->mode[i];
+
+        char ftype = '?';
+        if (S_ISREG(mode)) ftype = '-';
+        else if (S_ISDIR(mode)) ftype = 'd';
+        else if (S_ISLNK(mode)) ftype = 'l';
+        else if (S_ISCHR(mode)) ftype = 'c';
+        else if (S_ISBLK(mode)) ftype = 'b';
+        else if (S_ISFIFO(mode)) ftype = 'p';
+        else if (S_ISSOCK(mode)) ftype = 's';
+
+        char perms[10];
+        perms[0] = (mode & S_IRUSR) ? 'r' : '-';
+        perms[1] = (mode & S_IWUSR) ? 'w' : '-';
+        perms[2] = (mode & S_IXUSR) ? 'x' : '-';
+        perms[3] = (mode & S_IRGRP) ? 'r' : '-';
+        perms[4] = (mode & S_IWGRP) ? 'w' : '-';
+        perms[5] = (mode & S_IXGRP) ? 'x' : '-';
+        perms[6] = (mode & S_IROTH) ? 'r' : '-';
+        perms[7] = (mode & S_IWOTH) ? 'w' : '-';
+        perms[8] = (mode & S_IXOTH) ? 'x' : '-';
+        perms[9] = '\0';
+
+        time_t when = (time_t)dir->mtime[i];
+        char mtime[32];
+        if (ctime_r(&when, mtime) == NULL)
+            strcpy(mtime, "?\n");
+        mtime[strlen(mtime)-1] = '\0';
+
+        char line[512];
+        int n = snprintf(line, sizeof(line), "%c%s %lu ", ftype, perms,
+                         (unsigned long)dir->nlink[i]);
+        char *p = put_ids(line + n, dir, i, ids, numeric);
+        size_t room = sizeof(line) - (size_t)(p - line);
+        n = snprintf(p, room, "%5ld %s ", (long)dir->size[i], mtime);
+        if (n > (int)room - 1)
+            n = (int)room - 1;
+        lsv_out_write(out, line, (size_t)(p - line) + (size_t)n);
+
+        print_name(out, dir, i, colors);
+        const char *target = dir_link(dir, i);
+        if (target != NULL) {
+            lsv_out_write(out, " -> ", 4);
+            lsv_out_puts(out, target);
+        }
+        lsv_out_putc(out, '\n');
+    }
+}
+
+/* ===============================================
+   One Name per Line (-1)
+   =============================================== */
+static inline __attribute__((always_inline))
+void print_one_per_line(const struct lsv_dir *dir, const struct lsv_colors *colors,
+                        struct lsv_out *out)
+{
+    for (size_t i = 0; i < dir->count; i++) {
+        print_name(out, dir, i, colors);
+        lsv_out_putc(out, '\n');
+    }
+}
+
+/* ===============================================
+   Kernel Selection
+   =============================================== */
+static const struct lsv_colors *palette(const struct lsv_options *opts)
+{
+    return opts->colors ? opts->colors : lsv_colors_default();
+}
+
+/* Instantiates one layout with the palette fixed per directory (color)
+   or compiled out entirely (plain) */
+#define DEFINE_KERNELS(layout)                                                      \
+    static void layout##_plain(const struct lsv_dir *dir,                           \
+                               const struct lsv_options *opts, struct lsv_out *out) \
+    {                                                                               \
+        (void)opts;                                                                 \
+        if (dir->count > 0)                                                         \
+            layout(dir, NULL, out);                                                 \
+    }                                                                               \
+    static void layout##_color(const struct lsv_dir *dir,                           \
+                               const struct lsv_options *opts, struct lsv_out *out) \
+    {                                                                               \
+        if (dir->count > 0)                                                         \
+            layout(dir, palette(opts), out);                                        \
+    }
+
+DEFINE_KERNELS(print_in_columns)
+DEFINE_KERNELS(print_in_columns_horizontal)
+DEFINE_KERNELS(print_one_per_line)
+
+/* The long listing is instantiated once more per id format */
+#define DEFINE_LONG_KERNELS(name, numeric)                                        \
+    static void name##_plain(const struct lsv_dir *dir,                           \
+                             const struct lsv_options *opts, struct lsv_out *out) \
+    {                                                                             \
+        if (dir->count > 0)                                                       \
+            print_long(dir, NULL, opts->ids, numeric, out);                       \
+    }                                                                             \
+    static void name##_color(const struct lsv_dir *dir,                           \
+                             const struct lsv_options *opts, struct lsv_out *out) \
+    {                                                                             \
+        if (dir->count > 0)                                                       \
+            print_long(dir, palette(opts), opts->ids, numeric, out);              \
+    }
+
+DEFINE_LONG_KERNELS(print_long, 0)
+DEFINE_LONG_KERNELS(print_long_numeric, 1)
+
+static const lsv_render_fn text_kernels[][2] = {
+    [LSV_MODE_COLUMNS] = { print_in_columns_plain, print_in_columns_color },
+    [LSV_MODE_ACROSS]  = { print_in_columns_horizontal_plain, print_in_columns_horizontal_color },
+    [LSV_MODE_LONG]    = { print_long_plain, print_long_color },
+    [LSV_MODE_ONE]     = { print_one_per_line_plain, print_one_per_line_color },
+};
+
+lsv_render_fn lsv_render_select(const struct lsv_options *opts)
+{
+    switch (opts->format) {
+    case LSV_FORMAT_NUL:    return render_nul;
+    case LSV_FORMAT_JSONL:  return render_jsonl;
+    case LSV_FORMAT_BINARY: return render_binary;
+    default:
+        break;
+    }
+
+    size_t mode = (size_t)opts->mode;
+    if (mode == LSV_MODE_LONG && (opts->ids & LSV_IDS_NUMERIC))
+        return opts->color ? print_long_numeric_color : print_long_numeric_plain;
+    if (mode >= sizeof(text_kernels) / sizeof(text_kernels[0]))
+        mode = LSV_MODE_COLUMNS;
+    return text_kernels[mode][opts->color != 0];
+}
+
+void lsv_render_dir(const struct lsv_dir *dir, const struct lsv_options *opts,
+                    struct lsv_out *out)
+{
+    lsv_render_select(opts)(dir, opts, out);
+}
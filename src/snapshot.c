@@ -0,0 +1,1095 @@
+/*
+* liblsv: tree snapshots (--snapshot), diffs (--diff) and queries (--query)
+*
+* A snapshot lists every entry below a root as (path, mode, owner, inode,
+* size, mtime in nanoseconds), in "tree order": a directory is followed
+* by its subtree, siblings are ordered by strcmp(). That is the order of
+* byte-wise path comparison with '/' sorting first, so two snapshots, or
+* a snapshot and a live walk producing entries in the same order, are
+* compared with one linear merge and no sorting or hashing.
+*
+* The file is mmap()ed and read in place. Entries are stored column-wise
+* in blocks of SNAP_BLOCK, so a query predicate scans one dense array
+* (sizes, mtimes, modes...) instead of whole records, and every field of
+* entry i is found by arithmetic. Layout (host byte order):
+*   struct snap_header, root path                        once
+*   per block of n entries, each array 8-byte aligned:
+*     ino[n] size[n] mtime_ns[n]                        u64
+*     mode[n] uid[n] gid[n] parent[n] name_off[n + 1]   u32
+*     names                                             bytes
+*   block_off[nblocks + 1]                              u64, index_off
+*   struct snap_dir[ndirs]                              directory index
+* An entry stores its name and its parent's entry index. The directory
+* index maps each directory to the end of its subtree, which is a
+* contiguous range of entries: looking up a path prefix walks siblings by
+* jumping over whole subtrees, and a query under it scans only that range.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+#define SNAP_MAGIC     0x5356534cu  // "LSVS"
+#define SNAP_VERSION   2
+#define SNAP_BLOCK     65536        // entries per column block
+#define SNAP_NO_PARENT UINT32_MAX   // parent of the root's own entries
+
+struct snap_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t root_len;      // bytes of the root path that follow
+    uint64_t count;         // entries
+    uint64_t ndirs;         // directory index entries
+    uint64_t index_off;     // block offsets, then the directory index
+};
+
+struct snap_dir {
+    uint64_t index;         // entry index of the directory
+    uint64_t end;           // first entry past its subtree
+};
+
+/* One entry, from either a snapshot or the live tree */
+struct snap_entry {
+    const char *path;
+    size_t      path_len;
+    uint32_t    mode;
+    uint32_t    uid;
+    uint32_t    gid;
+    uint64_t    ino;
+    uint64_t    size;
+    int64_t     mtime_ns;
+};
+
+static int64_t to_ns(int64_t sec, uint32_t nsec)
+{
+    return sec * 1000000000 + nsec;
+}
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+enum { COL_INO, COL_SIZE, COL_MTIME, COL_MODE, COL_UID, COL_GID, COL_PARENT, COL_NAME_OFF, NCOLS };
+
+/* Byte offsets of each column in a block of n entries; returns the
+   offset of the name bytes */
+static size_t block_layout(size_t n, size_t off[NCOLS])
+{
+    size_t o = 0;
+    for (int c = 0; c < NCOLS; c++) {
+        off[c] = o;
+        o += c < COL_MODE ? n * 8 : c == COL_NAME_OFF ? (n + 1) * 4 : n * 4;
+    }
+    return o;
+}
+
+/* Tree order: like memcmp(), except that '/' sorts before every byte */
+static int path_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+    size_t n = alen < blen ? alen : blen;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char ca = (unsigned char)a[i], cb = (unsigned char)b[i];
+        if (ca == cb)
+            continue;
+        if (ca == '/')
+            return -1;
+        if (cb == '/')
+            return 1;
+        return ca < cb ? -1 : 1;
+    }
+    return alen < blen ? -1 : alen > blen;
+}
+
+static int reserve(void **p, size_t *cap, size_t need, size_t size)
+{
+    if (need <= *cap)
+        return 0;
+    size_t c = *cap ? *cap * 2 : 64;
+    while (c < need)
+        c *= 2;
+    void *grown = realloc(*p, c * size);
+    if (grown == NULL)
+        return -1;
+    *p = grown;
+    *cap = c;
+    return 0;
+}
+
+/* ===============================================
+   Reading Snapshots
+   =============================================== */
+struct lsv_snapshot {
+    const char            *map;
+    size_t                 map_len;
+    uint64_t               count;
+    uint64_t               nblocks;
+    const uint64_t        *block_off;
+    const struct snap_dir *dirs;
+    uint64_t               ndirs;
+    const char            *root;
+    size_t                 root_len;
+};
+
+/* The columns of one block, pointing into the mapping */
+struct snap_block {
+    uint64_t        first;      // entry index of column element 0
+    size_t          n;
+    const uint64_t *ino;
+    const uint64_t *size;
+    const int64_t  *mtime_ns;
+    const uint32_t *mode;
+    const uint32_t *uid;
+    const uint32_t *gid;
+    const uint32_t *parent;
+    const uint32_t *name_off;
+    const char     *names;
+    size_t          names_len;
+};
+
+struct lsv_snapshot *lsv_snapshot_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    struct snap_header h;
+    if (fstat(fd, &st) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    uint64_t nblocks = 0;
+    int ok = pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && h.magic == SNAP_MAGIC &&
+             h.version == SNAP_VERSION && h.count < SNAP_NO_PARENT && h.ndirs <= h.count;
+    if (ok) {
+        nblocks = (h.count + SNAP_BLOCK - 1) / SNAP_BLOCK;
+        ok = h.index_off % 8 == 0 && h.index_off <= size &&
+             sizeof(h) + h.root_len <= h.index_off &&
+             (size - h.index_off) / 8 >= nblocks + 1 + 2 * h.ndirs;
+    }
+    if (!ok) {
+        close(fd);
+        errno = EINVAL;     // not a snapshot, or from an incompatible version
+        return NULL;
+    }
+
+    struct lsv_snapshot *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        close(fd);
+        return NULL;
+    }
+    s->map_len = size;
+    s->map = mmap(NULL, s->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (s->map == MAP_FAILED) {
+        free(s);
+        return NULL;
+    }
+    s->count = h.count;
+    s->nblocks = nblocks;
+    s->block_off = (const uint64_t *)(s->map + h.index_off);
+    s->dirs = (const struct snap_dir *)(s->block_off + nblocks + 1);
+    s->ndirs = h.ndirs;
+    s->root = s->map + sizeof(h);
+    s->root_len = h.root_len;
+    return s;
+}
+
+void lsv_snapshot_close(struct lsv_snapshot *s)
+{
+    if (s == NULL)
+        return;
+    munmap((void *)s->map, s->map_len);
+    free(s);
+}
+
+/* Points blk at block b's columns; -1 if they don't fit the file */
+static int block_load(const struct lsv_snapshot *s, uint64_t b, struct snap_block *blk)
+{
+    if (b >= s->nblocks)
+        return -1;
+
+    size_t off[NCOLS];
+    uint64_t first = b * SNAP_BLOCK;
+    size_t n = s->count - first < SNAP_BLOCK ? (size_t)(s->count - first) : SNAP_BLOCK;
+    size_t names = block_layout(n, off);
+    uint64_t start = s->block_off[b], end = s->block_off[b + 1];
+    if (start % 8 != 0 || start > end || end > s->map_len || end - start < names)
+        return -1;
+
+    const char *base = s->map + start;
+    *blk = (struct snap_block){
+        .first = first, .n = n,
+        .ino = (const uint64_t *)(base + off[COL_INO]),
+        .size = (const uint64_t *)(base + off[COL_SIZE]),
+        .mtime_ns = (const int64_t *)(base + off[COL_MTIME]),
+        .mode = (const uint32_t *)(base + off[COL_MODE]),
+        .uid = (const uint32_t *)(base + off[COL_UID]),
+        .gid = (const uint32_t *)(base + off[COL_GID]),
+        .parent = (const uint32_t *)(base + off[COL_PARENT]),
+        .name_off = (const uint32_t *)(base + off[COL_NAME_OFF]),
+        .names = base + names,
+        .names_len = end - start - names,
+    };
+    return 0;
+}
+
+/* Name of column element k; NULL if its offsets are out of bounds */
+static const char *block_name(const struct snap_block *blk, size_t k, size_t *len)
+{
+    uint32_t a = blk->name_off[k], b = blk->name_off[k + 1];
+    if (a > b || b > blk->names_len)
+        return NULL;
+    *len = b - a;
+    return blk->names + a;
+}
+
+/* Makes blk hold entry i; returns its column index, or -1 */
+static long block_seek(const struct lsv_snapshot *s, uint64_t i, struct snap_block *blk)
+{
+    if (i >= s->count)
+        return -1;
+    if (blk->n == 0 || i < blk->first || i - blk->first >= blk->n) {
+        if (block_load(s, i / SNAP_BLOCK, blk) == -1)
+            return -1;
+    }
+    return (long)(i - blk->first);
+}
+
+/* First entry past the subtree of entry i (i + 1 for non-directories) */
+static uint64_t subtree_end(const struct lsv_snapshot *s, uint64_t i)
+{
+    size_t lo = 0, hi = s->ndirs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s->dirs[mid].index < i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < s->ndirs && s->dirs[lo].index == i && s->dirs[lo].end > i &&
+        s->dirs[lo].end <= s->count)
+        return s->dirs[lo].end;
+    return i + 1;
+}
+
+/* Sequential reader rebuilding full paths (for diffs) */
+struct snap_cursor {
+    const struct lsv_snapshot *snap;
+    struct snap_block blk;
+    uint64_t          next;     // entry after cur
+    char             *path;
+    size_t            path_cap;
+    struct { uint64_t index; size_t len; } *open;   // ancestors of next
+    size_t            depth;
+    size_t            open_cap;
+    struct snap_entry cur;
+    int               valid;    // cur holds an entry
+    int               corrupt;
+};
+
+static void cursor_next(struct snap_cursor *c)
+{
+    c->valid = 0;
+    if (c->next >= c->snap->count || c->corrupt)
+        return;
+
+    uint64_t i = c->next++;
+    long k = block_seek(c->snap, i, &c->blk);
+    size_t nlen;
+    const char *name = k < 0 ? NULL : block_name(&c->blk, (size_t)k, &nlen);
+    if (name == NULL) {
+        c->corrupt = 1;
+        return;
+    }
+
+    // Entries come after their parent: drop the ancestors we have left
+    uint32_t parent = c->blk.parent[k];
+    while (c->depth > 0 && c->open[c->depth - 1].index != parent)
+        c->depth--;
+    if (parent != SNAP_NO_PARENT && c->depth == 0) {
+        c->corrupt = 1;
+        return;
+    }
+
+    size_t prefix = c->depth ? c->open[c->depth - 1].len : 0;
+    size_t len = prefix + (prefix > 0) + nlen;
+    if (reserve((void **)&c->path, &c->path_cap, len + 1, 1) == -1) {
+        c->corrupt = 1;
+        return;
+    }
+    if (prefix > 0)
+        c->path[prefix] = '/';
+    memcpy(c->path + prefix + (prefix > 0), name, nlen);
+    c->path[len] = '\0';
+
+    uint32_t mode = c->blk.mode[k];
+    if (S_ISDIR(mode)) {
+        if (reserve((void **)&c->open, &c->open_cap, c->depth + 1, sizeof(*c->open)) == -1) {
+            c->corrupt = 1;
+            return;
+        }
+        c->open[c->depth].index = i;
+        c->open[c->depth].len = len;
+        c->depth++;
+    }
+
+    c->cur = (struct snap_entry){
+        .path = c->path, .path_len = len, .mode = mode,
+        .uid = c->blk.uid[k], .gid = c->blk.gid[k], .ino = c->blk.ino[k],
+        .size = c->blk.size[k], .mtime_ns = c->blk.mtime_ns[k],
+    };
+    c->valid = 1;
+}
+
+static void cursor_init(struct snap_cursor *c, const struct lsv_snapshot *s)
+{
+    memset(c, 0, sizeof(*c));
+    c->snap = s;
+    cursor_next(c);
+}
+
+static void cursor_free(struct snap_cursor *c)
+{
+    free(c->path);
+    free(c->open);
+}
+
+/* ===============================================
+   Live Tree Scan
+   =============================================== */
+struct scan {
+    struct lsv_options         opts;
+    const struct lsv_walk_ops *ops;
+    void                      *ctx;
+    char                      *rel;     // path below the root, no leading '/'
+    size_t                     rel_len;
+    size_t                     rel_cap;
+    // Called in tree order; a non-zero return for a directory skips its
+    // readdir() and hands it to unchanged() instead
+    int  (*emit)(struct scan *s, const struct snap_entry *e);
+    void (*unchanged)(struct scan *s, const char *path);
+    // Called after the subtree of each emitted directory
+    void (*leave)(struct scan *s);
+    void *state;
+};
+
+static int rel_push(struct scan *s, const char *name, size_t nlen)
+{
+    size_t need = s->rel_len + 1 + nlen + 1;
+    if (need > s->rel_cap) {
+        size_t cap = s->rel_cap ? s->rel_cap * 2 : 256;
+        while (cap < need)
+            cap *= 2;
+        char *p = realloc(s->rel, cap);
+        if (p == NULL)
+            return -1;
+        s->rel = p;
+        s->rel_cap = cap;
+    }
+    if (s->rel_len > 0)
+        s->rel[s->rel_len++] = '/';
+    memcpy(s->rel + s->rel_len, name, nlen);
+    s->rel_len += nlen;
+    s->rel[s->rel_len] = '\0';
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b, void *arg)
+{
+    const struct lsv_dir *d = arg;
+    return strcmp(dir_name(d, *(const uint32_t *)a), dir_name(d, *(const uint32_t *)b));
+}
+
+static void scan_dir(struct scan *s, const char *path)
+{
+    struct lsv_dir *d = lsv_dir_load(path, &s->opts);
+    if (d == NULL) {
+        if (s->ops && s->ops->error)
+            s->ops->error(path, "opendir", errno, s->ctx);
+        return;
+    }
+    if (d->read_errno && s->ops && s->ops->error)
+        s->ops->error(path, "readdir", d->read_errno, s->ctx);
+
+    // The table is in display order; tree order wants plain strcmp()
+    uint32_t *order = malloc((d->count ? d->count : 1) * sizeof(*order));
+    if (order == NULL) {
+        if (s->ops && s->ops->error)
+            s->ops->error(path, "readdir", ENOMEM, s->ctx);
+        lsv_dir_free(d);
+        return;
+    }
+    for (size_t i = 0; i < d->count; i++)
+        order[i] = (uint32_t)i;
+    qsort_r(order, d->count, sizeof(*order), compare_names, d);
+
+    for (size_t k = 0; k < d->count; k++) {
+        size_t i = order[k];
+        if (!dir_has_stat(d, i))
+            continue;   // vanished or unreadable since readdir()
+
+        size_t saved = s->rel_len;
+        if (rel_push(s, dir_name(d, i), d->name_len[i]) == -1) {
+            s->rel_len = saved;
+            continue;
+        }
+        struct snap_entry e = {
+            .path = s->rel, .path_len = s->rel_len, .mode = d->mode[i],
+            .uid = d->uid[i], .gid = d->gid[i], .ino = d->ino[i],
+            .size = (uint64_t)d->size[i], .mtime_ns = to_ns(d->mtime[i], d->mtime_nsec[i]),
+        };
+        int skip = s->emit(s, &e);
+
+        if (S_ISDIR(d->mode[i])) {
+            char *child = (d->flags[i] & ENTRY_PRUNE) ? NULL : join_path(path, dir_name(d, i));
+            if (child != NULL) {
+                if (!skip)
+                    scan_dir(s, child);
+                else if (s->unchanged)
+                    s->unchanged(s, child);
+                free(child);
+            }
+            if (s->leave)
+                s->leave(s);
+        }
+        s->rel_len = saved;
+        s->rel[saved] = '\0';
+    }
+    free(order);
+    lsv_dir_free(d);
+}
+
+static void scan_tree(struct scan *s, const char *root, const struct lsv_options *opts)
+{
+    s->opts = *opts;
+    s->opts.recursive = 1;
+    s->opts.need_stat = 1;
+    s->opts.format = LSV_FORMAT_NUL;    // no display widths needed
+    s->opts.cache = NULL;
+    if (s->opts.hidden == LSV_HIDDEN_ALL)
+        s->opts.hidden = LSV_HIDDEN_ALMOST;     // "." and ".." are not tree entries
+    scan_dir(s, root);
+    free(s->rel);
+    s->rel = NULL;
+}
+
+/* ===============================================
+   Writing Snapshots
+   =============================================== */
+struct block_buf {
+    uint64_t ino[SNAP_BLOCK];
+    uint64_t size[SNAP_BLOCK];
+    int64_t  mtime_ns[SNAP_BLOCK];
+    uint32_t mode[SNAP_BLOCK];
+    uint32_t uid[SNAP_BLOCK];
+    uint32_t gid[SNAP_BLOCK];
+    uint32_t parent[SNAP_BLOCK];
+    uint32_t name_off[SNAP_BLOCK + 1];
+};
+
+struct writer {
+    struct lsv_out   *out;
+    uint64_t          offset;   // file offset of the next byte written
+    struct block_buf *blk;      // the block being filled
+    size_t            n;
+    char             *names;
+    size_t            names_len;
+    size_t            names_cap;
+    uint64_t          count;
+    uint64_t         *block_off;
+    size_t            nblocks;
+    size_t            block_cap;
+    struct snap_dir  *dirs;     // in entry order: slots are taken on entry
+    size_t            ndirs;
+    size_t            dirs_cap;
+    size_t           *open;     // dirs slots of the directories being scanned
+    size_t            depth;
+    size_t            open_cap;
+    int               err;
+};
+
+static void put(struct writer *w, const void *p, size_t len)
+{
+    lsv_out_write(w->out, p, len);
+    w->offset += len;
+}
+
+static void pad8(struct writer *w)
+{
+    static const char zeros[8];
+    put(w, zeros, align8(w->offset) - w->offset);
+}
+
+static void flush_block(struct writer *w)
+{
+    struct block_buf *b = w->blk;
+    size_t n = w->n;
+
+    if (reserve((void **)&w->block_off, &w->block_cap, w->nblocks + 2, sizeof(*w->block_off)) == -1) {
+        w->err = ENOMEM;
+        return;
+    }
+    w->block_off[w->nblocks++] = w->offset;
+    b->name_off[n] = (uint32_t)w->names_len;
+    put(w, b->ino, n * 8);
+    put(w, b->size, n * 8);
+    put(w, b->mtime_ns, n * 8);
+    put(w, b->mode, n * 4);
+    put(w, b->uid, n * 4);
+    put(w, b->gid, n * 4);
+    put(w, b->parent, n * 4);
+    put(w, b->name_off, (n + 1) * 4);
+    put(w, w->names, w->names_len);
+    pad8(w);
+    w->n = 0;
+    w->names_len = 0;
+}
+
+static int emit_record(struct scan *s, const struct snap_entry *e)
+{
+    struct writer *w = s->state;
+    const char *name = memrchr(e->path, '/', e->path_len);
+    name = name ? name + 1 : e->path;
+    size_t nlen = e->path_len - (size_t)(name - e->path);
+
+    if (w->count >= SNAP_NO_PARENT - 1)
+        w->err = EOVERFLOW;
+    if (reserve((void **)&w->names, &w->names_cap, w->names_len + nlen, 1) == -1 ||
+        (S_ISDIR(e->mode) &&
+         (reserve((void **)&w->dirs, &w->dirs_cap, w->ndirs + 1, sizeof(*w->dirs)) == -1 ||
+          reserve((void **)&w->open, &w->open_cap, w->depth + 1, sizeof(*w->open)) == -1)))
+        w->err = ENOMEM;
+    if (w->err) {
+        // Keep the directory stack balanced for leave_record()
+        if (S_ISDIR(e->mode) && w->depth < w->open_cap)
+            w->open[w->depth++] = SIZE_MAX;
+        return 1;
+    }
+
+    struct block_buf *b = w->blk;
+    size_t k = w->n++;
+    b->ino[k] = e->ino;
+    b->size[k] = e->size;
+    b->mtime_ns[k] = e->mtime_ns;
+    b->mode[k] = e->mode;
+    b->uid[k] = e->uid;
+    b->gid[k] = e->gid;
+    b->parent[k] = w->depth ? (uint32_t)w->dirs[w->open[w->depth - 1]].index : SNAP_NO_PARENT;
+    b->name_off[k] = (uint32_t)w->names_len;
+    memcpy(w->names + w->names_len, name, nlen);
+    w->names_len += nlen;
+
+    if (S_ISDIR(e->mode)) {
+        w->dirs[w->ndirs] = (struct snap_dir){ .index = w->count, .end = 0 };
+        w->open[w->depth++] = w->ndirs++;
+    }
+    w->count++;
+    if (w->n == SNAP_BLOCK)
+        flush_block(w);
+    return 0;
+}
+
+static void leave_record(struct scan *s)
+{
+    struct writer *w = s->state;
+    if (w->depth == 0)
+        return;
+    size_t slot = w->open[--w->depth];
+    if (slot != SIZE_MAX)
+        w->dirs[slot].end = w->count;
+}
+
+/* Writes the snapshot to out_path.tmp and renames it into place */
+int lsv_snapshot_write(const char *root, const struct lsv_options *opts,
+                       const struct lsv_walk_ops *ops, void *ctx, const char *out_path)
+{
+    size_t len = strlen(out_path);
+    char *tmp = malloc(len + 5);
+    char *abs = realpath(root, NULL);
+    if (tmp == NULL || abs == NULL || strlen(abs) > UINT16_MAX) {
+        if (abs != NULL)
+            errno = ENAMETOOLONG;
+        free(tmp);
+        free(abs);
+        return -1;
+    }
+    memcpy(tmp, out_path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        free(tmp);
+        free(abs);
+        return -1;
+    }
+
+    struct writer w = { .out = lsv_out_open(fd), .blk = malloc(sizeof(struct block_buf)) };
+    struct snap_header h = {
+        .magic = SNAP_MAGIC, .version = SNAP_VERSION, .root_len = (uint16_t)strlen(abs),
+    };
+    int rc = -1;
+    int saved = ENOMEM;
+    if (w.out != NULL && w.blk != NULL) {
+        put(&w, &h, sizeof(h));
+        put(&w, abs, h.root_len);
+        pad8(&w);
+        struct scan s = {
+            .ops = ops, .ctx = ctx, .emit = emit_record, .leave = leave_record, .state = &w,
+        };
+        scan_tree(&s, root, opts);
+        if (w.n > 0)
+            flush_block(&w);
+
+        // Block offsets (plus the end of the last block) and the index
+        h.count = w.count;
+        h.ndirs = w.ndirs;
+        h.index_off = w.offset;
+        if (w.block_off != NULL)
+            put(&w, w.block_off, w.nblocks * sizeof(*w.block_off));
+        put(&w, &h.index_off, sizeof(h.index_off));
+        put(&w, w.dirs, w.ndirs * sizeof(*w.dirs));
+
+        saved = w.err;
+        if (lsv_out_close(w.out) == 0 && w.err == 0 &&
+            pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && fsync(fd) == 0)
+            rc = 0;
+        else if (saved == 0)
+            saved = errno;
+    } else if (w.out != NULL) {
+        lsv_out_close(w.out);
+    }
+    if (close(fd) == -1 && rc == 0) {
+        saved = errno;
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, out_path) == -1) {
+        saved = errno;
+        rc = -1;
+    }
+    if (rc == -1)
+        unlink(tmp);
+    free(w.blk);
+    free(w.names);
+    free(w.block_off);
+    free(w.dirs);
+    free(w.open);
+    free(tmp);
+    free(abs);
+    errno = saved;
+    return rc;
+}
+
+/* ===============================================
+   Diffing
+   =============================================== */
+struct differ {
+    struct snap_cursor old;
+    struct lsv_out    *out;
+    int                quick;
+    long               changes;
+};
+
+static void report(struct differ *df, char what, const char *path, size_t len)
+{
+    lsv_out_putc(df->out, what);
+    lsv_out_putc(df->out, '\t');
+    lsv_out_write(df->out, path, len);
+    lsv_out_putc(df->out, '\n');
+    df->changes++;
+}
+
+static int same_entry(const struct snap_entry *a, const struct snap_entry *b)
+{
+    return a->mode == b->mode && a->uid == b->uid && a->gid == b->gid && a->ino == b->ino &&
+           a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+static int is_below(const struct snap_entry *e, const char *dir, size_t dir_len)
+{
+    return e->path_len > dir_len && e->path[dir_len] == '/' &&
+           memcmp(e->path, dir, dir_len) == 0;
+}
+
+/* Advances the old side up to the new entry e; returns 1 when e is an
+   unchanged directory whose listing may be taken from the snapshot */
+static int merge_entry(struct differ *df, const struct snap_entry *e)
+{
+    struct snap_cursor *c = &df->old;
+    int cmp = -1;
+
+    while (c->valid && (cmp = path_cmp(c->cur.path, c->cur.path_len, e->path, e->path_len)) < 0) {
+        report(df, 'D', c->cur.path, c->cur.path_len);
+        cursor_next(c);
+    }
+    if (!c->valid || cmp > 0) {
+        report(df, 'A', e->path, e->path_len);
+        return 0;
+    }
+
+    int unchanged = same_entry(&c->cur, e);
+    if (!unchanged)
+        report(df, 'M', e->path, e->path_len);
+    cursor_next(c);
+
+    return df->quick && unchanged && S_ISDIR(e->mode);
+}
+
+static int emit_diff(struct scan *s, const struct snap_entry *e)
+{
+    return merge_entry(s->state, e);
+}
+
+/* Quick mode: a directory whose mtime matches the snapshot still has the
+   same names, so its listing comes from the snapshot and its files are
+   trusted unchanged. Only the subdirectories are lstat()ed, since entries
+   created or removed further down change their mtime, not this one's. */
+static void replay_dir(struct scan *s, const char *path)
+{
+    struct differ *df = s->state;
+    struct snap_cursor *c = &df->old;
+    size_t dir_len = s->rel_len;
+
+    while (c->valid && is_below(&c->cur, s->rel, dir_len)) {
+        if (!S_ISDIR(c->cur.mode)) {
+            cursor_next(c);
+            continue;
+        }
+        const char *name = c->cur.path + dir_len + 1;
+        char *child = join_path(path, name);
+        if (child == NULL || rel_push(s, name, c->cur.path_len - dir_len - 1) == -1) {
+            free(child);
+            break;      // the remaining entries are reported by the caller's merge
+        }
+
+        struct stat st;
+        if (lstat(child, &st) == -1) {
+            // Gone despite the unchanged parent (a racing rename)
+            report(df, 'D', s->rel, s->rel_len);
+            cursor_next(c);
+            while (c->valid && is_below(&c->cur, s->rel, s->rel_len)) {
+                report(df, 'D', c->cur.path, c->cur.path_len);
+                cursor_next(c);
+            }
+        } else {
+            struct snap_entry e = {
+                .path = s->rel, .path_len = s->rel_len, .mode = st.st_mode,
+                .uid = st.st_uid, .gid = st.st_gid, .ino = st.st_ino, .size = (uint64_t)st.st_size,
+                .mtime_ns = to_ns(st.st_mtim.tv_sec, (uint32_t)st.st_mtim.tv_nsec),
+            };
+            if (emit_diff(s, &e))
+                replay_dir(s, child);
+            else if (S_ISDIR(st.st_mode))
+                scan_dir(s, child);
+        }
+        free(child);
+        s->rel_len = dir_len;
+        s->rel[dir_len] = '\0';
+    }
+}
+
+static long finish_diff(struct differ *df)
+{
+    while (df->old.valid) {
+        report(df, 'D', df->old.cur.path, df->old.cur.path_len);
+        cursor_next(&df->old);
+    }
+    cursor_free(&df->old);
+    if (df->old.corrupt) {
+        errno = EINVAL;
+        return -1;
+    }
+    return df->changes;
+}
+
+long lsv_diff_snapshots(const struct lsv_snapshot *a, const struct lsv_snapshot *b,
+                        struct lsv_out *out)
+{
+    struct differ df = { .out = out };
+    struct snap_cursor nc;
+
+    cursor_init(&df.old, a);
+    for (cursor_init(&nc, b); nc.valid; cursor_next(&nc))
+        merge_entry(&df, &nc.cur);
+    cursor_free(&nc);
+
+    long rc = finish_diff(&df);
+    if (nc.corrupt) {
+        errno = EINVAL;
+        return -1;
+    }
+    return rc;
+}
+
+long lsv_diff_tree(const struct lsv_snapshot *a, const char *root, const struct lsv_options *opts,
+                   int flags, const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out)
+{
+    struct differ df = { .out = out, .quick = (flags & LSV_DIFF_QUICK) != 0 };
+    struct scan s = {
+        .ops = ops, .ctx = ctx, .emit = emit_diff, .unchanged = replay_dir, .state = &df,
+    };
+
+    cursor_init(&df.old, a);
+    scan_tree(&s, root, opts);
+    return finish_diff(&df);
+}
+
+/* ===============================================
+   Queries
+   =============================================== */
+void lsv_query_init(struct lsv_query *q)
+{
+    memset(q, 0, sizeof(*q));
+    q->max_size = UINT64_MAX;
+    q->min_mtime = INT64_MIN;
+    q->max_mtime = INT64_MAX;
+    q->uid = -1;
+}
+
+struct query_run {
+    const struct lsv_snapshot *snap;
+    struct snap_block blk;      // block being scanned
+    struct snap_block aux;      // for name lookups and parent chains
+    uint64_t *chain;
+    size_t    chain_cap;
+    char     *dir;              // path of dir_index, relative to the root
+    size_t    dir_len;
+    size_t    dir_cap;
+    uint64_t  dir_index;        // SNAP_NO_PARENT: none built yet
+};
+
+/* Finds the entry named name among the siblings in [lo, hi) */
+static int64_t find_child(struct query_run *r, uint64_t lo, uint64_t hi,
+                          const char *name, size_t len)
+{
+    for (uint64_t i = lo; i < hi; i = subtree_end(r->snap, i)) {
+        long k = block_seek(r->snap, i, &r->aux);
+        size_t nlen;
+        const char *n = k < 0 ? NULL : block_name(&r->aux, (size_t)k, &nlen);
+        if (n == NULL)
+            return -1;
+        int cmp = memcmp(n, name, nlen < len ? nlen : len);
+        if (cmp == 0 && nlen == len)
+            return (int64_t)i;
+        if (cmp > 0 || (cmp == 0 && nlen > len))
+            break;      // siblings are in strcmp() order
+    }
+    return -1;
+}
+
+/* Resolves under (absolute below the snapshot root, or relative to it)
+   to the entry range of its subtree */
+static int resolve_under(struct query_run *r, const char *under, uint64_t *lo, uint64_t *hi)
+{
+    const struct lsv_snapshot *s = r->snap;
+
+    *lo = 0;
+    *hi = s->count;
+    if (under == NULL)
+        return 0;
+    if (under[0] == '/') {
+        size_t n = s->root_len;
+        while (n > 0 && s->root[n - 1] == '/')
+            n--;
+        if (strncmp(under, s->root, n) != 0 || (under[n] != '/' && under[n] != '\0'))
+            return -1;
+        under += n;
+    }
+
+    while (*under) {
+        const char *end = strchrnul(under, '/');
+        size_t len = (size_t)(end - under);
+        if (len > 0 && !(len == 1 && under[0] == '.')) {
+            int64_t i = find_child(r, *lo, *hi, under, len);
+            if (i < 0)
+                return -1;
+            long k = block_seek(s, (uint64_t)i, &r->aux);
+            if (S_ISDIR(r->aux.mode[k])) {
+                *lo = (uint64_t)i + 1;
+                *hi = subtree_end(s, (uint64_t)i);
+            } else if (*end == '\0') {
+                *lo = (uint64_t)i;  // a single file
+                *hi = *lo + 1;
+            } else {
+                return -1;
+            }
+        }
+        under = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* Makes r->dir the path of directory entry d */
+static int build_dir(struct query_run *r, uint64_t d)
+{
+    size_t n = 0;
+    for (uint64_t i = d; i != SNAP_NO_PARENT; n++) {
+        long k = block_seek(r->snap, i, &r->aux);
+        if (k < 0 || (r->aux.parent[k] >= i && r->aux.parent[k] != SNAP_NO_PARENT) ||
+            reserve((void **)&r->chain, &r->chain_cap, n + 1, sizeof(*r->chain)) == -1)
+            return -1;
+        r->chain[n] = i;
+        i = r->aux.parent[k];
+    }
+
+    r->dir_len = 0;
+    while (n-- > 0) {
+        long k = block_seek(r->snap, r->chain[n], &r->aux);
+        size_t nlen;
+        const char *name = block_name(&r->aux, (size_t)k, &nlen);
+        if (name == NULL ||
+            reserve((void **)&r->dir, &r->dir_cap, r->dir_len + nlen + 2, 1) == -1)
+            return -1;
+        if (r->dir_len > 0)
+            r->dir[r->dir_len++] = '/';
+        memcpy(r->dir + r->dir_len, name, nlen);
+        r->dir_len += nlen;
+    }
+    r->dir_index = d;
+    return 0;
+}
+
+static int print_match(struct query_run *r, size_t k, char terminator, struct lsv_out *out)
+{
+    uint32_t parent = r->blk.parent[k];
+    size_t nlen;
+    const char *name = block_name(&r->blk, k, &nlen);
+
+    if (name == NULL)
+        return -1;
+    if (parent != SNAP_NO_PARENT) {
+        if (parent != r->dir_index && build_dir(r, parent) == -1)
+            return -1;
+        lsv_out_write(out, r->dir, r->dir_len);
+        lsv_out_putc(out, '/');
+    }
+    lsv_out_write(out, name, nlen);
+    lsv_out_putc(out, terminator);
+    return 0;
+}
+
+/* Each predicate is one pass over a single column, compacting the list
+   of surviving column indexes; the cheap numeric ones run first */
+static size_t keep_mtime(const struct snap_block *b, uint32_t *sel, size_t n, int64_t lo, int64_t hi)
+{
+    size_t m = 0;
+    for (size_t j = 0; j < n; j++) {
+        int64_t t = b->mtime_ns[sel[j]];
+        sel[m] = sel[j];
+        m += t >= lo && t <= hi;
+    }
+    return m;
+}
+
+static size_t keep_type(const struct snap_block *b, uint32_t *sel, size_t n, uint32_t type)
+{
+    size_t m = 0;
+    for (size_t j = 0; j < n; j++) {
+        sel[m] = sel[j];
+        m += (b->mode[sel[j]] & S_IFMT) == type;
+    }
+    return m;
+}
+
+static size_t keep_uid(const struct snap_block *b, uint32_t *sel, size_t n, uint32_t uid)
+{
+    size_t m = 0;
+    for (size_t j = 0; j < n; j++) {
+        sel[m] = sel[j];
+        m += b->uid[sel[j]] == uid;
+    }
+    return m;
+}
+
+static size_t keep_name(const struct snap_block *b, uint32_t *sel, size_t n, const char *glob)
+{
+    char buf[NAME_MAX + 1];
+    size_t m = 0;
+    for (size_t j = 0; j < n; j++) {
+        size_t nlen;
+        const char *name = block_name(b, sel[j], &nlen);
+        if (name == NULL || nlen > NAME_MAX)
+            continue;
+        memcpy(buf, name, nlen);
+        buf[nlen] = '\0';
+        if (fnmatch(glob, buf, 0) == 0)
+            sel[m++] = sel[j];
+    }
+    return m;
+}
+
+long lsv_snapshot_query(const struct lsv_snapshot *snap, const struct lsv_query *q,
+                        char terminator, struct lsv_out *out)
+{
+    struct query_run r = { .snap = snap, .dir_index = SNAP_NO_PARENT };
+    uint32_t *sel = malloc(SNAP_BLOCK * sizeof(*sel));
+    uint64_t lo, hi;
+    long matches = 0;
+    int err = 0;
+
+    if (sel == NULL)
+        return -1;
+    if (resolve_under(&r, q->under, &lo, &hi) == -1) {
+        err = ENOENT;
+        goto done;
+    }
+
+    for (uint64_t i = lo; i < hi; ) {
+        long k0 = block_seek(snap, i, &r.blk);
+        if (k0 < 0) {
+            err = EINVAL;
+            goto done;
+        }
+        size_t k1 = hi - r.blk.first < r.blk.n ? (size_t)(hi - r.blk.first) : r.blk.n;
+
+        // Size bounds seed the selection: branch-free over the whole range
+        size_t n = 0;
+        for (size_t k = (size_t)k0; k < k1; k++) {
+            uint64_t size = r.blk.size[k];
+            sel[n] = (uint32_t)k;
+            n += size >= q->min_size && size <= q->max_size;
+        }
+        if (n > 0 && (q->min_mtime != INT64_MIN || q->max_mtime != INT64_MAX))
+            n = keep_mtime(&r.blk, sel, n, q->min_mtime, q->max_mtime);
+        if (n > 0 && q->type != 0)
+            n = keep_type(&r.blk, sel, n, q->type);
+        if (n > 0 && q->uid >= 0)
+            n = keep_uid(&r.blk, sel, n, (uint32_t)q->uid);
+        if (n > 0 && q->name != NULL)
+            n = keep_name(&r.blk, sel, n, q->name);
+
+        for (size_t j = 0; j < n; j++) {
+            if (print_match(&r, sel[j], terminator, out) == -1) {
+                err = EINVAL;
+                goto done;
+            }
+        }
+        matches += (long)n;
+        i = r.blk.first + k1;
+    }
+
+done:
+    free(sel);
+    free(r.chain);
+    free(r.dir);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return matches;
+}
@@ -0,0 +1,132 @@
+/*
+* liblsv: string-keyed hash map
+*
+* Open addressing with linear probing over (hash, key, value) slots. Keys
+* are copied and compared by length first, so lookups of names that are
+* not NUL-terminated at the right place (suffixes, extensions) work.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsv_int.h"
+
+uint64_t strmap_hash(const char *key, size_t len)
+{
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static struct strmap_slot *probe(const struct strmap *m, const char *key, size_t len,
+                                 uint64_t hash)
+{
+    size_t mask = m->cap - 1;
+    size_t i = hash & mask;
+
+    while (m->slots[i].key != NULL) {
+        const struct strmap_slot *s = &m->slots[i];
+        if (s->hash == hash && s->len == len && memcmp(s->key, key, len) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return &m->slots[i];
+}
+
+static int grow(struct strmap *m)
+{
+    size_t cap = m->cap ? m->cap * 2 : 16;
+    struct strmap_slot *old = m->slots;
+    size_t old_cap = m->cap;
+
+    m->slots = calloc(cap, sizeof(*m->slots));
+    if (m->slots == NULL) {
+        m->slots = old;
+        return -1;
+    }
+    m->cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].key != NULL)
+            *probe(m, old[i].key, old[i].len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+const struct strmap_slot *strmap_find(const struct strmap *m, const char *key, size_t len)
+{
+    if (m->count == 0)
+        return NULL;
+    const struct strmap_slot *s = probe(m, key, len, strmap_hash(key, len));
+    return s->key != NULL ? s : NULL;
+}
+
+/* Inserts or replaces; returns the slot, or NULL when out of memory.
+   Replacing the value of a present key never allocates. */
+struct strmap_slot *strmap_put(struct strmap *m, const char *key, size_t len, void *value)
+{
+    uint64_t hash = strmap_hash(key, len);
+    struct strmap_slot *s = m->cap ? probe(m, key, len, hash) : NULL;
+    if (s == NULL || s->key == NULL) {
+        if ((m->count + 1) * 4 > m->cap * 3) {
+            if (grow(m) == -1)
+                return NULL;
+            s = probe(m, key, len, hash);
+        }
+        char *copy = malloc(len + 1);
+        if (copy == NULL)
+            return NULL;
+        memcpy(copy, key, len);
+        copy[len] = '\0';
+        s->key = copy;
+        s->len = len;
+        s->hash = hash;
+        m->count++;
+    }
+    s->value = value;
+    return s;
+}
+
+/* Deletes key if present. Later slots of its probe run move back into
+   the hole, so lookups never need tombstones. */
+void strmap_remove(struct strmap *m, const char *key, size_t len)
+{
+    if (m->count == 0)
+        return;
+    struct strmap_slot *s = probe(m, key, len, strmap_hash(key, len));
+    if (s->key == NULL)
+        return;
+    free((char *)s->key);
+
+    size_t mask = m->cap - 1;
+    size_t hole = (size_t)(s - m->slots);
+    for (size_t i = (hole + 1) & mask; m->slots[i].key != NULL; i = (i + 1) & mask) {
+        // Slot i may move back unless its home lies between the hole and i
+        size_t home = m->slots[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m->slots[hole] = m->slots[i];
+            hole = i;
+        }
+    }
+    memset(&m->slots[hole], 0, sizeof(m->slots[hole]));
+    m->count--;
+}
+
+void strmap_free(struct strmap *m, void (*free_value)(void *))
+{
+    for (size_t i = 0; i < m->cap; i++) {
+        if (m->slots[i].key == NULL)
+            continue;
+        free((char *)m->slots[i].key);
+        if (free_value)
+            free_value(m->slots[i].value);
+    }
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
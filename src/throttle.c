@@ -0,0 +1,185 @@
+/*
+* liblsv: background scanning (--nice-io, --max-dirs, --max-stats)
+*
+* A throttle sits in front of the loader's system calls:
+*   - token buckets cap directory opens and lstat() calls per second.
+*     Tokens are taken in batches; a bucket may go into debt, and the
+*     caller sleeps until the debt is repaid, so bursts stay within one
+*     batch of the configured rate;
+*   - with adaptive backoff, latency is tracked per unit of work as an
+*     EWMA against a slowly rising baseline (the best latency seen
+*     lately), separately for lstat() batches (per call) and directory
+*     reads (per entry read, so directories of different sizes compare;
+*     reads under DIR_MIN_ENTRIES entries are mostly the fixed cost of
+*     open() and are not observed). When the file system answers more
+*     than twice as slow as a baseline, the scan's duty cycle is halved
+*     (at most once per COOLDOWN observations); it recovers additively
+*     while latency stays near the baseline. At duty cycle s, a batch
+*     that took T is followed by a sleep of T * (1/s - 1). So --count
+*     and other walks without lstat() back off too.
+* lsv_nice_io() moves the process into the idle I/O scheduling class, so
+* the block layer serves it only when nobody else is waiting for disk.
+* A throttle is not locked; use it for one walk at a time.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "lsv_int.h"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_CLASS_SHIFT 13
+
+#define EWMA_WEIGHT   0.0625
+#define SLOW_FACTOR   2.0       // latency vs baseline that triggers backoff
+#define CALM_FACTOR   1.25      // latency vs baseline that allows recovery
+#define SCALE_MIN     (1.0 / 64)
+#define SCALE_STEP    (1.0 / 32)
+#define BASELINE_RISE 1.002     // per observation, so old minimums expire
+#define COOLDOWN      16        // observations between two backoffs
+#define DIR_MIN_ENTRIES 64      // smallest directory read worth observing
+
+struct bucket {
+    double   rate;          // tokens per second, 0: unlimited
+    double   tokens;        // may go negative (debt)
+    uint64_t last_ns;
+    double   ewma_ns;       // per lstat(), or per entry read for directories
+    double   baseline_ns;
+    uint64_t ops;
+    uint64_t busy_ns;       // time spent inside the system calls
+};
+
+struct lsv_throttle {
+    struct bucket kind[THROTTLE_KINDS];
+    int      adaptive;
+    double   scale;         // duty cycle, 1: full speed
+    double   scale_min;
+    uint64_t backoffs;
+    unsigned cooldown;      // observations left before the next backoff
+    uint64_t waited_ns;     // sleeping for tokens or backoff
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ns(struct lsv_throttle *t, uint64_t ns)
+{
+    struct timespec ts = { .tv_sec = (time_t)(ns / 1000000000), .tv_nsec = (long)(ns % 1000000000) };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+    t->waited_ns += ns;
+}
+
+int lsv_nice_io(void)
+{
+    return (int)syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                        IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+}
+
+struct lsv_throttle *lsv_throttle_new(double dirs_per_sec, double stats_per_sec, int adaptive)
+{
+    struct lsv_throttle *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+
+    uint64_t now = now_ns();
+    t->kind[THROTTLE_DIR].rate = dirs_per_sec > 0 ? dirs_per_sec : 0;
+    t->kind[THROTTLE_STAT].rate = stats_per_sec > 0 ? stats_per_sec : 0;
+    for (int k = 0; k < THROTTLE_KINDS; k++)
+        t->kind[k].last_ns = now;
+    t->adaptive = adaptive;
+    t->scale = 1.0;
+    t->scale_min = 1.0;
+    return t;
+}
+
+void lsv_throttle_free(struct lsv_throttle *t)
+{
+    free(t);
+}
+
+/* Waits until n operations of this kind may start; returns the time */
+uint64_t throttle_begin(struct lsv_throttle *t, int kind, size_t n)
+{
+    struct bucket *b = &t->kind[kind];
+    uint64_t now = now_ns();
+
+    if (b->rate > 0) {
+        // Refill, allowing at most a tenth of a second (or one batch) of burst
+        double burst = b->rate / 10 > (double)n ? b->rate / 10 : (double)n;
+        b->tokens += (double)(now - b->last_ns) * b->rate / 1e9;
+        if (b->tokens > burst)
+            b->tokens = burst;
+        b->last_ns = now;
+        b->tokens -= (double)n;
+        if (b->tokens < 0) {
+            sleep_ns(t, (uint64_t)(-b->tokens / b->rate * 1e9));
+            now = now_ns();
+            b->tokens = 0;
+            b->last_ns = now;
+        }
+    }
+    return now;
+}
+
+/* Records n operations started at start, which did units of work (the
+   lstat() calls themselves, or the entries a directory read returned),
+   and applies the adaptive backoff */
+void throttle_end(struct lsv_throttle *t, int kind, size_t n, size_t units, uint64_t start)
+{
+    struct bucket *b = &t->kind[kind];
+    uint64_t took = now_ns() - start;
+
+    b->ops += n;
+    b->busy_ns += took;
+    if (units == 0 || (kind == THROTTLE_DIR && units < DIR_MIN_ENTRIES))
+        return;
+
+    double per_op = (double)took / (double)units;
+    b->ewma_ns = b->ewma_ns == 0 ? per_op : b->ewma_ns + EWMA_WEIGHT * (per_op - b->ewma_ns);
+    b->baseline_ns = b->baseline_ns == 0 || b->ewma_ns < b->baseline_ns ?
+                     b->ewma_ns : b->baseline_ns * BASELINE_RISE;
+    if (!t->adaptive)
+        return;
+
+    if (t->cooldown > 0) {
+        t->cooldown--;
+    } else if (b->ewma_ns > SLOW_FACTOR * b->baseline_ns) {
+        if (t->scale > SCALE_MIN) {
+            t->scale = t->scale / 2 < SCALE_MIN ? SCALE_MIN : t->scale / 2;
+            t->backoffs++;
+        }
+        t->cooldown = COOLDOWN;     // let the EWMA see the new pace first
+    } else if (b->ewma_ns < CALM_FACTOR * b->baseline_ns && t->scale < 1.0) {
+        t->scale = t->scale + SCALE_STEP > 1.0 ? 1.0 : t->scale + SCALE_STEP;
+    }
+    if (t->scale < t->scale_min)
+        t->scale_min = t->scale;
+    if (t->scale < 1.0)
+        sleep_ns(t, (uint64_t)((double)took * (1 / t->scale - 1)));
+}
+
+void lsv_throttle_stats(const struct lsv_throttle *t, struct lsv_throttle_stats *out)
+{
+    const struct bucket *d = &t->kind[THROTTLE_DIR], *s = &t->kind[THROTTLE_STAT];
+
+    memset(out, 0, sizeof(*out));
+    out->dirs = d->ops;
+    out->stats = s->ops;
+    out->dir_us = d->ops ? (double)d->busy_ns / (double)d->ops / 1e3 : 0;
+    out->stat_us = s->ops ? (double)s->busy_ns / (double)s->ops / 1e3 : 0;
+    out->waited_sec = (double)t->waited_ns / 1e9;
+    out->backoffs = t->backoffs;
+    out->scale_min = t->scale_min;
+}
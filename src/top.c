@@ -0,0 +1,103 @@
+/*
+* liblsv: top-N largest / newest files across a tree (--top N --by ...)
+*
+* Every regular file the walker loads is offered to a bounded heap; the
+* joined path is only built for entries that actually enter the heap.
+* Nothing is printed until lsv_top_finish() emits the ranked list.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+struct lsv_top {
+    int         by;         // enum lsv_top_key
+    struct topn heap;
+    char       *path;       // scratch buffer for dir/name
+    size_t      path_cap;
+};
+
+struct lsv_top *lsv_top_new(size_t n, int by)
+{
+    struct lsv_top *top = calloc(1, sizeof(*top));
+    if (top == NULL)
+        return NULL;
+    if (topn_init(&top->heap, n) == -1) {
+        free(top);
+        return NULL;
+    }
+    top->by = by;
+    return top;
+}
+
+void lsv_top_free(struct lsv_top *top)
+{
+    if (top == NULL)
+        return;
+    topn_free(&top->heap);
+    free(top->path);
+    free(top);
+}
+
+static uint64_t mtime_key(int64_t mtime)
+{
+    // Offset so pre-1970 timestamps still order correctly as unsigned
+    return (uint64_t)mtime + (UINT64_C(1) << 63);
+}
+
+void lsv_top_visit(struct lsv_top *top, const struct lsv_dir *dir)
+{
+    size_t dlen = strlen(dir->path);
+
+    for (size_t i = 0; i < dir->count; i++) {
+        if (!dir_has_stat(dir, i) || !S_ISREG(dir->mode[i]))
+            continue;
+
+        uint64_t key = top->by == LSV_TOP_MTIME ? mtime_key(dir->mtime[i]) : (uint64_t)dir->size[i];
+        if (!topn_accepts(&top->heap, key))
+            continue;
+
+        size_t len = dlen + 1 + dir->name_len[i];
+        if (len + 1 > top->path_cap) {
+            char *p = realloc(top->path, len + 1);
+            if (p == NULL)
+                continue;
+            top->path = p;
+            top->path_cap = len + 1;
+        }
+        memcpy(top->path, dir->path, dlen);
+        top->path[dlen] = '/';
+        memcpy(top->path + dlen + 1, dir_name(dir, i), dir->name_len[i]);
+
+        uint64_t val[TOPN_VALS] = { (uint64_t)dir->size[i], (uint64_t)dir->mtime[i], 0 };
+        topn_offer(&top->heap, key, val, top->path, len);
+    }
+}
+
+/* Prints "size<TAB>YYYY-MM-DD HH:MM:SS<TAB>path", best first */
+void lsv_top_finish(struct lsv_top *top, struct lsv_out *out)
+{
+    topn_sort(&top->heap);
+    for (size_t i = 0; i < top->heap.count; i++) {
+        const struct topn_item *it = &top->heap.items[i];
+        time_t mtime = (time_t)(int64_t)it->val[1];
+        struct tm tm;
+        char when[32] = "?";
+
+        if (localtime_r(&mtime, &tm) != NULL)
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+
+        lsv_out_u64(out, it->val[0]);
+        lsv_out_putc(out, '\t');
+        lsv_out_puts(out, when);
+        lsv_out_putc(out, '\t');
+        lsv_out_puts(out, it->label);
+        lsv_out_putc(out, '\n');
+    }
+    topn_free(&top->heap);
+}
@@ -0,0 +1,113 @@
+/*
+* liblsv: bounded top-N selection
+*
+* A min-heap of at most N items keyed by a u64. Offering an item that
+* does not beat the current minimum costs one compare and no allocation,
+* so memory stays O(N) no matter how many entries a walk produces.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsv_int.h"
+
+int topn_init(struct topn *t, size_t cap)
+{
+    memset(t, 0, sizeof(*t));
+    if (cap == 0)
+        return 0;
+    t->items = calloc(cap, sizeof(*t->items));
+    if (t->items == NULL)
+        return -1;
+    t->cap = cap;
+    return 0;
+}
+
+void topn_free(struct topn *t)
+{
+    for (size_t i = 0; i < t->count; i++)
+        free(t->items[i].label);
+    free(t->items);
+    memset(t, 0, sizeof(*t));
+}
+
+static void swap_items(struct topn_item *a, struct topn_item *b)
+{
+    struct topn_item tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_up(struct topn *t, size_t i)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (t->items[parent].key <= t->items[i].key)
+            break;
+        swap_items(&t->items[parent], &t->items[i]);
+        i = parent;
+    }
+}
+
+static void sift_down(struct topn *t, size_t i)
+{
+    for (;;) {
+        size_t left = 2 * i + 1;
+        size_t smallest = i;
+        if (left < t->count && t->items[left].key < t->items[smallest].key)
+            smallest = left;
+        if (left + 1 < t->count && t->items[left + 1].key < t->items[smallest].key)
+            smallest = left + 1;
+        if (smallest == i)
+            break;
+        swap_items(&t->items[i], &t->items[smallest]);
+        i = smallest;
+    }
+}
+
+/* Returns 1 if the item was kept. The label is copied only in that case. */
+int topn_offer(struct topn *t, uint64_t key, const uint64_t val[TOPN_VALS],
+               const char *label, size_t label_len)
+{
+    if (t->cap == 0)
+        return 0;
+    if (t->count == t->cap && key <= t->items[0].key)
+        return 0;
+
+    char *copy = malloc(label_len + 1);
+    if (copy == NULL)
+        return 0;
+    memcpy(copy, label, label_len);
+    copy[label_len] = '\0';
+
+    struct topn_item item = { .key = key, .label = copy };
+    memcpy(item.val, val, sizeof(item.val));
+
+    if (t->count < t->cap) {
+        t->items[t->count] = item;
+        sift_up(t, t->count++);
+    } else {
+        free(t->items[0].label);
+        t->items[0] = item;
+        sift_down(t, 0);
+    }
+    return 1;
+}
+
+static int compare_desc(const void *a, const void *b)
+{
+    const struct topn_item *itemA = a;
+    const struct topn_item *itemB = b;
+    if (itemA->key != itemB->key)
+        return itemA->key < itemB->key ? 1 : -1;
+    return strcmp(itemA->label, itemB->label);
+}
+
+/* Sorts the kept items largest first; the heap property is lost */
+void topn_sort(struct topn *t)
+{
+    if (t->count > 1)
+        qsort(t->items, t->count, sizeof(*t->items), compare_desc);
+}
@@ -0,0 +1,775 @@
+/*
+* liblsv: recursive walker (-R)
+*
+* The serial walker alternates between blocking I/O (open, readdir,
+* lstat) and the caller's CPU work (sort, format, print). With
+* opts->prefetch > 0 the walk is split into two stages:
+*   - a reader thread runs the depth-first traversal, loading and
+*     stat'ing each directory and queueing visit / leave / error events;
+*   - the calling thread pops events in order and runs the callbacks.
+* The queue holds at most opts->prefetch events, so the reader stays a
+* bounded distance ahead. A directory is freed by the calling thread
+* after its leave event; the reader only reads it until then.
+*
+* With opts->inode_order the serial and pipelined walkers load a
+* directory's subdirectories in batches, each in inode order, so the reads
+* behind a cold -R mostly move forward on disk. Tables loaded ahead of the
+* walk count against one walk-wide budget (the ring capacity when
+* pipelined), so they never pile up level after level. The checkpointed walker
+* keeps pending directories as paths that can be saved, so it only gets
+* the loader's inode-ordered lstat()s.
+*
+* lsv_walk_many() walks a stream of roots (--from-file) through the same
+* stages: the reader moves on to the next root while the previous one is
+* still being rendered, and events stay in input order.
+*
+* lsv_walk_checkpointed() walks serially from an explicit stack that can
+* be saved to a file and reloaded (--checkpoint / --resume).
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "lsv_int.h"
+
+char *join_path(const char *dir, const char *name)
+{
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    char *path = malloc(dlen + nlen + 2);
+    if (path == NULL)
+        return NULL;
+    memcpy(path, dir, dlen);
+    path[dlen] = '/';
+    memcpy(path + dlen + 1, name, nlen + 1);
+    return path;
+}
+
+static int entry_is_dir(const struct lsv_dir *d, size_t i, const char *path)
+{
+    if (dir_has_stat(d, i))
+        return S_ISDIR(d->mode[i]);
+    if (d->type[i] != DT_UNKNOWN)
+        return d->type[i] == DT_DIR;
+
+    struct stat st;
+    return lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Returns the path of entry i if the walk should descend into it */
+static char *child_path(const struct lsv_dir *d, size_t i)
+{
+    const char *name = dir_name(d, i);
+    if ((d->flags[i] & ENTRY_PRUNE) || is_dot_or_dotdot(name))
+        return NULL;
+
+    char *child = join_path(d->path, name);
+    if (child != NULL && !entry_is_dir(d, i, child)) {
+        free(child);
+        return NULL;
+    }
+    return child;
+}
+
+/* ===============================================
+   Subdirectory Batches
+   =============================================== */
+#define WARM_BATCH 64
+
+struct ino_index {
+    uint64_t ino;
+    uint32_t idx;
+};
+
+static int compare_ino(const void *a, const void *b)
+{
+    uint64_t x = ((const struct ino_index *)a)->ino, y = ((const struct ino_index *)b)->ino;
+    return (x > y) - (x < y);
+}
+
+static struct lsv_dir *load_dir(const char *path, const struct lsv_options *opts)
+{
+    return opts->cache ? cache_get(opts->cache, path, opts) : lsv_dir_load(path, opts);
+}
+
+static void release_dir(struct lsv_dir *d, const struct lsv_options *opts)
+{
+    if (opts->cache)
+        cache_put(d);
+    else
+        lsv_dir_free(d);
+}
+
+/* Tables loaded ahead of the walk, across every level of it */
+struct warm_budget {
+    size_t held;
+    size_t max;
+};
+
+/* The subdirectories of one directory, handed out in display order.
+   With opts->inode_order the next WARM_BATCH of them are loaded at once
+   in ascending inode order, as far as the walk's budget allows, so the
+   reads behind a cold -R mostly move forward on disk, and the walk gets
+   the loaded tables: every directory is still opened and read exactly
+   once. The rest are loaded as the walk reaches them. */
+struct subdirs {
+    const struct lsv_dir     *d;
+    const struct lsv_options *opts;
+    struct warm_budget       *budget;
+    size_t          scan;                   // next entry of d to look at
+    size_t          count;                  // subdirectories in the batch
+    size_t          pos;                    // next one to hand out
+    char           *path[WARM_BATCH];
+    struct lsv_dir *dir[WARM_BATCH];        // NULL: not loaded yet
+    int             err[WARM_BATCH];        // errno of a failed preload
+};
+
+static void subdirs_init(struct subdirs *s, const struct lsv_dir *d, const struct lsv_options *opts,
+                         struct warm_budget *budget)
+{
+    s->d = d;
+    s->opts = opts;
+    s->budget = budget;
+    s->scan = 0;
+    s->count = 0;
+    s->pos = 0;
+}
+
+static void fill_batch(struct subdirs *s)
+{
+    const struct lsv_dir *d = s->d;
+    struct ino_index order[WARM_BATCH];
+
+    s->count = 0;
+    s->pos = 0;
+    while (s->count < WARM_BATCH && s->scan < d->count) {
+        size_t i = s->scan++;
+        char *child = child_path(d, i);
+        if (child == NULL)
+            continue;
+        order[s->count].ino = dir_has_stat(d, i) ? d->ino[i] : 0;
+        order[s->count].idx = (uint32_t)s->count;
+        s->path[s->count] = child;
+        s->dir[s->count] = NULL;
+        s->err[s->count] = 0;
+        s->count++;
+    }
+    if (!s->opts->inode_order || d->ino == NULL || s->count < 2)
+        return;     // loaded one by one as the walk reaches them
+
+    qsort(order, s->count, sizeof(*order), compare_ino);
+    for (size_t k = 0; k < s->count && s->budget->held < s->budget->max; k++) {
+        size_t j = order[k].idx;
+        if ((s->dir[j] = load_dir(s->path[j], s->opts)) == NULL)
+            s->err[j] = errno;
+        else
+            s->budget->held++;
+    }
+}
+
+/* Returns the next subdirectory's path (the caller frees it) and its
+   table, or NULL with *err set if it cannot be opened; NULL when done */
+static char *subdirs_next(struct subdirs *s, struct lsv_dir **dir, int *err)
+{
+    if (s->pos == s->count)
+        fill_batch(s);
+    if (s->pos == s->count)
+        return NULL;
+
+    size_t k = s->pos++;
+    *dir = s->dir[k];
+    *err = s->err[k];
+    if (*dir != NULL)
+        s->budget->held--;      // the walk owns it from here
+    else if (*err == 0 && (*dir = load_dir(s->path[k], s->opts)) == NULL)
+        *err = errno;
+    return s->path[k];
+}
+
+/* Drops what a stopped walk did not reach */
+static void subdirs_free(struct subdirs *s)
+{
+    for (size_t k = s->pos; k < s->count; k++) {
+        if (s->dir[k] != NULL) {
+            release_dir(s->dir[k], s->opts);
+            s->budget->held--;
+        }
+        free(s->path[k]);
+    }
+    s->pos = s->count;
+}
+
+/* ===============================================
+   Serial Walk
+   =============================================== */
+static int walk_loaded(const char *path, struct lsv_dir *d, int err, int depth,
+                       struct warm_budget *budget, const struct lsv_options *opts,
+                       const struct lsv_walk_ops *ops, void *ctx)
+{
+    if (d == NULL) {
+        if (ops->error)
+            ops->error(path, "opendir", err, ctx);
+        return 0;
+    }
+    if (d->read_errno && ops->error)
+        ops->error(path, "readdir", d->read_errno, ctx);
+
+    int rc = ops->visit ? ops->visit(d, depth, ctx) : 0;
+
+    if (rc == 0 && opts->recursive) {
+        struct subdirs s;
+        struct lsv_dir *child_dir;
+        char *child;
+        subdirs_init(&s, d, opts, budget);
+        while (rc == 0 && (child = subdirs_next(&s, &child_dir, &err)) != NULL) {
+            rc = walk_loaded(child, child_dir, err, depth + 1, budget, opts, ops, ctx);
+            free(child);
+        }
+        subdirs_free(&s);
+    }
+
+    if (ops->leave)
+        ops->leave(d, depth, ctx);
+    release_dir(d, opts);
+    return rc;
+}
+
+static int walk_dir(const char *path, int depth, const struct lsv_options *opts,
+                    const struct lsv_walk_ops *ops, void *ctx)
+{
+    struct warm_budget budget = { .max = WARM_BATCH };
+    struct lsv_dir *d = load_dir(path, opts);
+    return walk_loaded(path, d, d ? 0 : errno, depth, &budget, opts, ops, ctx);
+}
+
+/* ===============================================
+   Pipelined Walk
+   =============================================== */
+enum walk_event_kind {
+    EV_VISIT,
+    EV_LEAVE,
+    EV_ERROR,
+    EV_DONE
+};
+
+struct walk_event {
+    int             kind;
+    int             depth;
+    struct lsv_dir *dir;    // EV_VISIT, EV_LEAVE
+    char           *path;   // EV_ERROR
+    const char     *what;
+    int             err;
+};
+
+struct pipeline {
+    const struct lsv_options *opts;
+    const char *(*next_root)(void *src);
+    void                     *src;
+
+    pthread_mutex_t    lock;
+    pthread_cond_t     not_full;
+    pthread_cond_t     not_empty;
+    struct walk_event *ring;
+    size_t             cap;
+    size_t             head;
+    size_t             count;
+    int                stop;    // the visitor asked to end the walk
+
+    struct warm_budget budget;  // reader only; max is the ring capacity
+};
+
+/* Queues an event, waiting for room; returns non-zero once stopped */
+static int push_event(struct pipeline *p, const struct walk_event *ev)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == p->cap)
+        pthread_cond_wait(&p->not_full, &p->lock);
+    p->ring[(p->head + p->count) % p->cap] = *ev;
+    int stop = p->stop;
+    if (p->count++ == 0)    // one reader, one visitor: wake only on a state change
+        pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+    return stop;
+}
+
+static void pop_event(struct pipeline *p, struct walk_event *ev)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == 0)
+        pthread_cond_wait(&p->not_empty, &p->lock);
+    *ev = p->ring[p->head];
+    p->head = (p->head + 1) % p->cap;
+    if (p->count-- == p->cap)
+        pthread_cond_signal(&p->not_full);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static int push_error(struct pipeline *p, const char *path, const char *what, int err)
+{
+    struct walk_event ev = { .kind = EV_ERROR, .path = strdup(path), .what = what, .err = err };
+    return push_event(p, &ev);
+}
+
+/* Same traversal order as walk_loaded(), producing events instead of calls */
+static int produce_loaded(struct pipeline *p, const char *path, struct lsv_dir *d, int err,
+                          int depth)
+{
+    if (d == NULL)
+        return push_error(p, path, "opendir", err);
+
+    int stop = 0;
+    if (d->read_errno)
+        stop = push_error(p, path, "readdir", d->read_errno);
+    if (!stop) {
+        struct walk_event visit = { .kind = EV_VISIT, .depth = depth, .dir = d };
+        stop = push_event(p, &visit);
+    }
+
+    if (!stop && p->opts->recursive) {
+        struct subdirs s;
+        struct lsv_dir *child_dir;
+        char *child;
+        subdirs_init(&s, d, p->opts, &p->budget);
+        while (!stop && (child = subdirs_next(&s, &child_dir, &err)) != NULL) {
+            stop = produce_loaded(p, child, child_dir, err, depth + 1);
+            free(child);
+        }
+        subdirs_free(&s);
+    }
+
+    // Last touch of d here: the calling thread frees it after leave
+    struct walk_event leave = { .kind = EV_LEAVE, .depth = depth, .dir = d };
+    return push_event(p, &leave);
+}
+
+static void *reader_main(void *arg)
+{
+    struct pipeline *p = arg;
+    struct walk_event done = { .kind = EV_DONE };
+    const char *root;
+    int stop = 0;
+
+    while (!stop && (root = p->next_root(p->src)) != NULL) {
+        struct lsv_dir *d = lsv_dir_load(root, p->opts);
+        stop = produce_loaded(p, root, d, d ? 0 : errno, 0);
+    }
+    push_event(p, &done);
+    return NULL;
+}
+
+static int walk_serial(const char *(*next_root)(void *src), void *src,
+                       const struct lsv_options *opts, const struct lsv_walk_ops *ops, void *ctx)
+{
+    const char *root;
+    int rc = 0;
+
+    while (rc == 0 && (root = next_root(src)) != NULL)
+        rc = walk_dir(root, 0, opts, ops, ctx);
+    return rc;
+}
+
+/* The reader walks every root in turn, so it runs ahead across root
+   boundaries as well as down into subdirectories */
+static int walk_pipelined(const char *(*next_root)(void *src), void *src, int depth,
+                          const struct lsv_options *opts, const struct lsv_walk_ops *ops, void *ctx)
+{
+    struct pipeline p = { .opts = opts, .next_root = next_root, .src = src, .cap = (size_t)depth,
+                          .budget = { .max = (size_t)depth } };
+    pthread_t reader;
+
+    p.ring = malloc(p.cap * sizeof(*p.ring));
+    if (p.ring == NULL)
+        return walk_serial(next_root, src, opts, ops, ctx);
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.not_full, NULL);
+    pthread_cond_init(&p.not_empty, NULL);
+
+    if (pthread_create(&reader, NULL, reader_main, &p) != 0) {
+        pthread_cond_destroy(&p.not_empty);
+        pthread_cond_destroy(&p.not_full);
+        pthread_mutex_destroy(&p.lock);
+        free(p.ring);
+        return walk_serial(next_root, src, opts, ops, ctx);
+    }
+
+    int rc = 0;
+    struct walk_event ev;
+    for (pop_event(&p, &ev); ev.kind != EV_DONE; pop_event(&p, &ev)) {
+        if (ev.kind == EV_ERROR) {
+            // Reported only while a serial walk would still be running
+            if (rc == 0 && ops->error && ev.path != NULL)
+                ops->error(ev.path, ev.what, ev.err, ctx);
+            free(ev.path);
+        } else if (ev.kind == EV_VISIT) {
+            if (rc == 0) {
+                ev.dir->visited = 1;
+                rc = ops->visit ? ops->visit(ev.dir, ev.depth, ctx) : 0;
+                if (rc != 0) {
+                    pthread_mutex_lock(&p.lock);
+                    p.stop = 1;
+                    pthread_mutex_unlock(&p.lock);
+                }
+            }
+        } else {
+            if (ev.dir->visited && ops->leave)
+                ops->leave(ev.dir, ev.depth, ctx);
+            lsv_dir_free(ev.dir);
+        }
+    }
+
+    pthread_join(reader, NULL);
+    pthread_cond_destroy(&p.not_empty);
+    pthread_cond_destroy(&p.not_full);
+    pthread_mutex_destroy(&p.lock);
+    free(p.ring);
+    return rc;
+}
+
+/* ===============================================
+   Checkpointed Walk
+   =============================================== */
+/* The recursion is replaced by an explicit stack of directories still to
+   visit (children pushed in reverse, so they pop in listing order and the
+   visit order matches walk_dir()). That stack is the whole state of the
+   walk, so saving it together with the output offset is a checkpoint.
+   Loaded tables are freed as soon as their children are pushed. */
+#define CP_MAGIC   0x4b56534cu  // "LSVK"
+#define CP_VERSION 1
+
+struct cp_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t root_len;      // root path bytes after the header
+    int64_t  out_offset;    // output file offset, -1 if not seekable
+    uint64_t count;         // pending records that follow the root
+};
+
+struct cp_record {
+    uint32_t depth;
+    uint32_t path_len;      // path bytes that follow
+};
+
+struct pending {
+    char  *path;
+    int    depth;
+};
+
+struct frontier {
+    struct pending *items;
+    size_t          count;
+    size_t          cap;
+};
+
+static int frontier_push(struct frontier *f, char *path, int depth)
+{
+    if (f->count == f->cap) {
+        size_t cap = f->cap ? f->cap * 2 : 64;
+        struct pending *items = realloc(f->items, cap * sizeof(*items));
+        if (items == NULL)
+            return -1;
+        f->items = items;
+        f->cap = cap;
+    }
+    f->items[f->count].path = path;
+    f->items[f->count].depth = depth;
+    f->count++;
+    return 0;
+}
+
+static void frontier_free(struct frontier *f)
+{
+    for (size_t i = 0; i < f->count; i++)
+        free(f->items[i].path);
+    free(f->items);
+}
+
+/* Flushes out and returns its offset, synced to disk for regular files */
+static int64_t out_offset(struct lsv_out *out)
+{
+    struct stat st;
+
+    if (lsv_out_flush(out) == -1)
+        return -2;
+    if (fstat(out->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return -1;
+    off_t off = lseek(out->fd, 0, SEEK_CUR);
+    if (off == -1 || fdatasync(out->fd) == -1)
+        return -2;
+    return off;
+}
+
+/* Writes the frontier to cp_path.tmp, then renames it over cp_path */
+static int save_checkpoint(const char *cp_path, const char *root, const struct frontier *f,
+                           struct lsv_out *out)
+{
+    int64_t offset = out_offset(out);
+    if (offset == -2)
+        return -1;
+
+    size_t len = strlen(cp_path);
+    char *tmp = malloc(len + 5);
+    if (tmp == NULL)
+        return -1;
+    memcpy(tmp, cp_path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        free(tmp);
+        return -1;
+    }
+    struct lsv_out *cp = lsv_out_open(fd);
+    struct cp_header h = {
+        .magic = CP_MAGIC, .version = CP_VERSION, .root_len = (uint16_t)strlen(root),
+        .out_offset = offset, .count = f->count,
+    };
+    int rc = -1;
+    if (cp != NULL) {
+        lsv_out_write(cp, &h, sizeof(h));
+        lsv_out_write(cp, root, h.root_len);
+        for (size_t i = 0; i < f->count; i++) {
+            struct cp_record r = {
+                .depth = (uint32_t)f->items[i].depth, .path_len = (uint32_t)strlen(f->items[i].path),
+            };
+            lsv_out_write(cp, &r, sizeof(r));
+            lsv_out_write(cp, f->items[i].path, r.path_len);
+        }
+        if (lsv_out_close(cp) == 0 && fsync(fd) == 0)
+            rc = 0;
+    }
+    int saved = errno;
+    if (close(fd) == -1 && rc == 0) {
+        saved = errno;
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, cp_path) == -1) {
+        saved = errno;
+        rc = -1;
+    }
+    if (rc == -1)
+        unlink(tmp);
+    free(tmp);
+    errno = saved;
+    return rc;
+}
+
+static int read_full(int fd, void *buf, size_t n)
+{
+    for (size_t done = 0; done < n; ) {
+        ssize_t got = read(fd, (char *)buf + done, n - done);
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got <= 0) {
+            if (got == 0)
+                errno = EINVAL;     // truncated checkpoint
+            return -1;
+        }
+        done += (size_t)got;
+    }
+    return 0;
+}
+
+/* Refills the frontier from cp_path and rewinds a regular-file out to
+   the offset it had when the checkpoint was taken */
+static int load_checkpoint(const char *cp_path, const char *root, struct frontier *f,
+                           struct lsv_out *out)
+{
+    int fd = open(cp_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct cp_header h;
+    char *saved_root = NULL;
+    int rc = -1;
+    if (read_full(fd, &h, sizeof(h)) == -1)
+        goto done;
+    if (h.magic != CP_MAGIC || h.version != CP_VERSION) {
+        errno = EINVAL;
+        goto done;
+    }
+    if ((saved_root = malloc((size_t)h.root_len + 1)) == NULL ||
+        read_full(fd, saved_root, h.root_len) == -1)
+        goto done;
+    saved_root[h.root_len] = '\0';
+    if (strcmp(saved_root, root) != 0) {
+        errno = EXDEV;      // checkpoint of a different walk
+        goto done;
+    }
+
+    for (uint64_t i = 0; i < h.count; i++) {
+        struct cp_record r;
+        char *path;
+        if (read_full(fd, &r, sizeof(r)) == -1 || (path = malloc((size_t)r.path_len + 1)) == NULL)
+            goto done;
+        if (read_full(fd, path, r.path_len) == -1 || frontier_push(f, path, (int)r.depth) == -1) {
+            free(path);
+            goto done;
+        }
+        path[r.path_len] = '\0';
+    }
+
+    // Output written after the checkpoint is produced again: drop it.
+    // A file already shorter than the offset (reopened with '>') is left as is.
+    struct stat st;
+    if (h.out_offset >= 0 && fstat(out->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size >= h.out_offset) {
+        if (ftruncate(out->fd, h.out_offset) == -1 ||
+            lseek(out->fd, h.out_offset, SEEK_SET) == -1)
+            goto done;
+    }
+    rc = 0;
+done:
+    free(saved_root);
+    close(fd);
+    return rc;
+}
+
+static int64_t now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+int lsv_walk_checkpointed(const char *root, const struct lsv_options *opts,
+                          const struct lsv_walk_ops *ops, void *ctx, struct lsv_out *out,
+                          const char *cp_path, unsigned interval, int resume)
+{
+    struct frontier f = { 0 };
+    int rc = 0;
+
+    if (ops->leave != NULL || strlen(root) > UINT16_MAX) {
+        errno = EINVAL;     // post-order state is not part of a checkpoint
+        return -1;
+    }
+    if (resume) {
+        if (load_checkpoint(cp_path, root, &f, out) == -1) {
+            int saved = errno;
+            frontier_free(&f);
+            errno = saved;
+            return -1;
+        }
+    } else {
+        char *start = strdup(root);
+        if (start == NULL || frontier_push(&f, start, 0) == -1) {
+            free(start);
+            return -1;
+        }
+    }
+
+    int64_t next_save = now_sec() + interval;
+    while (f.count > 0) {
+        struct pending top = f.items[--f.count];
+        struct lsv_dir *d = lsv_dir_load(top.path, opts);
+        if (d == NULL) {
+            if (ops->error)
+                ops->error(top.path, "opendir", errno, ctx);
+            free(top.path);
+            continue;
+        }
+        if (d->read_errno && ops->error)
+            ops->error(top.path, "readdir", d->read_errno, ctx);
+
+        if (ops->visit && (rc = ops->visit(d, top.depth, ctx)) != 0) {
+            // Not consumed: the directory is still pending in the checkpoint
+            f.items[f.count++] = top;
+            lsv_dir_free(d);
+            rc = save_checkpoint(cp_path, root, &f, out) == -1 ? -1 : 1;
+            frontier_free(&f);
+            return rc;
+        }
+
+        size_t base = f.count;
+        for (size_t i = 0; opts->recursive && i < d->count; i++) {
+            char *child = child_path(d, i);
+            if (child != NULL && frontier_push(&f, child, top.depth + 1) == -1) {
+                free(child);
+                if (ops->error)
+                    ops->error(top.path, "readdir", ENOMEM, ctx);
+                break;
+            }
+        }
+        // Pushed in listing order; reverse so the first child pops first
+        for (size_t i = base, j = f.count; i + 1 < j; i++, j--) {
+            struct pending t = f.items[i];
+            f.items[i] = f.items[j - 1];
+            f.items[j - 1] = t;
+        }
+        lsv_dir_free(d);
+        free(top.path);
+
+        if (f.count > 0 && now_sec() >= next_save) {
+            if (save_checkpoint(cp_path, root, &f, out) == -1) {
+                int saved = errno;
+                frontier_free(&f);
+                errno = saved;
+                return -1;
+            }
+            next_save = now_sec() + interval;
+        }
+    }
+
+    frontier_free(&f);
+    unlink(cp_path);    // complete: nothing left to resume
+    return 0;
+}
+
+/* ===============================================
+   Walk Entry Points
+   =============================================== */
+struct single_root {
+    const char *root;
+    int         taken;
+};
+
+static const char *next_single(void *src)
+{
+    struct single_root *s = src;
+    return s->taken++ ? NULL : s->root;
+}
+
+/* A reader thread only pays off when it can run beside the visitor.
+   The CPU count is read from sysfs, so only walks that could use the
+   thread ask for it, once per process. */
+static int prefetch_depth(const struct lsv_options *opts)
+{
+    static int cpus;
+
+    if (opts->prefetch != LSV_PREFETCH_AUTO)
+        return opts->prefetch;
+    if (cpus == 0)
+        cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 1 ? LSV_PREFETCH_DEFAULT : 0;
+}
+
+int lsv_walk(const char *root, const struct lsv_options *opts,
+             const struct lsv_walk_ops *ops, void *ctx)
+{
+    struct single_root s = { .root = root };
+
+    // Cached directories mostly come from memory: nothing to overlap
+    int depth = opts->recursive && opts->cache == NULL ? prefetch_depth(opts) : 0;
+    if (depth > 0)
+        return walk_pipelined(next_single, &s, depth, opts, ops, ctx);
+    return walk_dir(root, 0, opts, ops, ctx);
+}
+
+int lsv_walk_many(const char *(*next_root)(void *src), void *src,
+                  const struct lsv_options *opts, const struct lsv_walk_ops *ops, void *ctx)
+{
+    // Many short listings overlap as well as one deep one
+    int depth = opts->cache == NULL ? prefetch_depth(opts) : 0;
+    if (depth > 0)
+        return walk_pipelined(next_root, src, depth, opts, ops, ctx);
+    return walk_serial(next_root, src, opts, ops, ctx);
+}
@@ -0,0 +1,208 @@
+/*
+* liblsv: display width of file names
+*
+* Column layout needs the number of terminal cells a name occupies, not
+* its byte length. Almost every name is pure ASCII, so the leading ASCII
+* run is measured 16 bytes at a time (SSE2, part of x86-64), or 32 when
+* the CPU has AVX2: that routine is compiled for AVX2 on its own and
+* picked at run time, since the build targets baseline x86-64. Only the
+* remainder is decoded as UTF-8 and looked up in a compact range table of
+* zero-width and double-width code points. Invalid UTF-8 bytes count as
+* one cell each, which is how a terminal shows their replacement.
+*
+* The width is computed once per entry by the loader and cached in the
+* entry table, so layout and padding never rescan names.
+*/
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#define WIDTH_AVX2 1
+#endif
+
+#include "lsv_int.h"
+
+/* ===============================================
+   ASCII Fast Path
+   =============================================== */
+/* Length of the ASCII run of s[0..len) that starts at i */
+static size_t ascii_run(const char *s, size_t i, size_t len)
+{
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(v);
+        if (mask != 0)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        if (w & 0x8080808080808080ULL)
+            break;
+    }
+    while (i < len && (unsigned char)s[i] < 0x80)
+        i++;
+    return i;
+}
+
+#if WIDTH_AVX2
+__attribute__((target("avx2")))
+static size_t ascii_run_avx2(const char *s, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(v);
+        if (mask != 0)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    return ascii_run(s, i, len);
+}
+#endif
+
+static size_t ascii_prefix(const char *s, size_t len)
+{
+#if WIDTH_AVX2
+    // Reads a flag libgcc set at startup; short names never get here
+    if (len >= 32 && __builtin_cpu_supports("avx2"))
+        return ascii_run_avx2(s, len);
+#endif
+    return ascii_run(s, 0, len);
+}
+
+/* ===============================================
+   Width Table
+   =============================================== */
+struct width_range {
+    uint32_t lo;
+    uint32_t hi;
+    uint8_t  width;
+};
+
+/* Sorted, non-overlapping. Combining marks and format characters are 0,
+   East Asian Wide/Fullwidth blocks and emoji presentation blocks are 2;
+   everything else is 1. */
+static const struct width_range width_table[] = {
+    { 0x0300, 0x036F, 0 }, { 0x0483, 0x0489, 0 }, { 0x0591, 0x05BD, 0 },
+    { 0x05BF, 0x05BF, 0 }, { 0x05C1, 0x05C2, 0 }, { 0x05C4, 0x05C5, 0 },
+    { 0x05C7, 0x05C7, 0 }, { 0x0610, 0x061A, 0 }, { 0x064B, 0x065F, 0 },
+    { 0x0670, 0x0670, 0 }, { 0x06D6, 0x06DC, 0 }, { 0x06DF, 0x06E4, 0 },
+    { 0x06E7, 0x06E8, 0 }, { 0x06EA, 0x06ED, 0 }, { 0x0900, 0x0902, 0 },
+    { 0x093A, 0x093A, 0 }, { 0x093C, 0x093C, 0 }, { 0x0941, 0x0948, 0 },
+    { 0x094D, 0x094D, 0 }, { 0x0951, 0x0957, 0 }, { 0x0E31, 0x0E31, 0 },
+    { 0x0E34, 0x0E3A, 0 }, { 0x0E47, 0x0E4E, 0 }, { 0x1100, 0x115F, 2 },
+    { 0x1160, 0x11FF, 0 }, { 0x1AB0, 0x1AFF, 0 }, { 0x1DC0, 0x1DFF, 0 },
+    { 0x200B, 0x200F, 0 }, { 0x202A, 0x202E, 0 }, { 0x2060, 0x2064, 0 },
+    { 0x20D0, 0x20FF, 0 }, { 0x231A, 0x231B, 2 }, { 0x2329, 0x232A, 2 },
+    { 0x23E9, 0x23EC, 2 }, { 0x23F0, 0x23F0, 2 }, { 0x23F3, 0x23F3, 2 },
+    { 0x25FD, 0x25FE, 2 }, { 0x2614, 0x2615, 2 }, { 0x2648, 0x2653, 2 },
+    { 0x267F, 0x267F, 2 }, { 0x2693, 0x2693, 2 }, { 0x26A1, 0x26A1, 2 },
+    { 0x26AA, 0x26AB, 2 }, { 0x26BD, 0x26BE, 2 }, { 0x26C4, 0x26C5, 2 },
+    { 0x26CE, 0x26CE, 2 }, { 0x26D4, 0x26D4, 2 }, { 0x26EA, 0x26EA, 2 },
+    { 0x26F2, 0x26F3, 2 }, { 0x26F5, 0x26F5, 2 }, { 0x26FA, 0x26FA, 2 },
+    { 0x26FD, 0x26FD, 2 }, { 0x2705, 0x2705, 2 }, { 0x270A, 0x270B, 2 },
+    { 0x2728, 0x2728, 2 }, { 0x274C, 0x274C, 2 }, { 0x274E, 0x274E, 2 },
+    { 0x2753, 0x2755, 2 }, { 0x2757, 0x2757, 2 }, { 0x2795, 0x2797, 2 },
+    { 0x27B0, 0x27B0, 2 }, { 0x27BF, 0x27BF, 2 }, { 0x2B1B, 0x2B1C, 2 },
+    { 0x2B50, 0x2B50, 2 }, { 0x2B55, 0x2B55, 2 }, { 0x2E80, 0x303E, 2 },
+    { 0x3041, 0x3098, 2 }, { 0x3099, 0x309A, 0 }, { 0x309B, 0x33FF, 2 },
+    { 0x3400, 0x4DBF, 2 }, { 0x4E00, 0x9FFF, 2 }, { 0xA000, 0xA4CF, 2 },
+    { 0xA960, 0xA97F, 2 }, { 0xAC00, 0xD7A3, 2 }, { 0xD7B0, 0xD7FF, 0 },
+    { 0xF900, 0xFAFF, 2 }, { 0xFE00, 0xFE0F, 0 }, { 0xFE10, 0xFE19, 2 },
+    { 0xFE20, 0xFE2F, 0 }, { 0xFE30, 0xFE6F, 2 }, { 0xFEFF, 0xFEFF, 0 },
+    { 0xFF00, 0xFF60, 2 }, { 0xFFE0, 0xFFE6, 2 }, { 0x16FE0, 0x16FE4, 2 },
+    { 0x17000, 0x18CFF, 2 }, { 0x1B000, 0x1B2FF, 2 }, { 0x1F004, 0x1F004, 2 },
+    { 0x1F0CF, 0x1F0CF, 2 }, { 0x1F18E, 0x1F18E, 2 }, { 0x1F191, 0x1F19A, 2 },
+    { 0x1F200, 0x1F265, 2 }, { 0x1F300, 0x1F320, 2 }, { 0x1F32D, 0x1F335, 2 },
+    { 0x1F337, 0x1F37C, 2 }, { 0x1F37E, 0x1F393, 2 }, { 0x1F3A0, 0x1F3CA, 2 },
+    { 0x1F3CF, 0x1F3D3, 2 }, { 0x1F3E0, 0x1F3F0, 2 }, { 0x1F3F4, 0x1F3F4, 2 },
+    { 0x1F3F8, 0x1F3FA, 2 }, { 0x1F3FB, 0x1F3FF, 0 }, { 0x1F400, 0x1F43E, 2 },
+    { 0x1F440, 0x1F440, 2 }, { 0x1F442, 0x1F4FC, 2 }, { 0x1F4FF, 0x1F53D, 2 },
+    { 0x1F54B, 0x1F54E, 2 }, { 0x1F550, 0x1F567, 2 }, { 0x1F57A, 0x1F57A, 2 },
+    { 0x1F595, 0x1F596, 2 }, { 0x1F5A4, 0x1F5A4, 2 }, { 0x1F5FB, 0x1F64F, 2 },
+    { 0x1F680, 0x1F6C5, 2 }, { 0x1F6CC, 0x1F6CC, 2 }, { 0x1F6D0, 0x1F6D2, 2 },
+    { 0x1F6D5, 0x1F6D7, 2 }, { 0x1F6DC, 0x1F6DF, 2 }, { 0x1F6EB, 0x1F6EC, 2 },
+    { 0x1F6F4, 0x1F6FC, 2 }, { 0x1F7E0, 0x1F7EB, 2 }, { 0x1F7F0, 0x1F7F0, 2 },
+    { 0x1F90C, 0x1F93A, 2 }, { 0x1F93C, 0x1F945, 2 }, { 0x1F947, 0x1F9FF, 2 },
+    { 0x1FA70, 0x1FAFF, 2 }, { 0x20000, 0x2FFFD, 2 }, { 0x30000, 0x3FFFD, 2 },
+    { 0xE0001, 0xE007F, 0 }, { 0xE0100, 0xE01EF, 0 },
+};
+
+static unsigned codepoint_width(uint32_t cp)
+{
+    if (cp < width_table[0].lo)
+        return 1;
+
+    size_t lo = 0, hi = sizeof(width_table) / sizeof(width_table[0]);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cp < width_table[mid].lo)
+            hi = mid;
+        else if (cp > width_table[mid].hi)
+            lo = mid + 1;
+        else
+            return width_table[mid].width;
+    }
+    return 1;
+}
+
+/* Decodes one UTF-8 sequence; returns its length, or 0 if malformed */
+static size_t decode_utf8(const unsigned char *s, size_t len, uint32_t *cp)
+{
+    unsigned char c = s[0];
+    size_t n;
+    uint32_t v;
+
+    if (c >= 0xC2 && c <= 0xDF) { n = 2; v = c & 0x1F; }
+    else if (c >= 0xE0 && c <= 0xEF) { n = 3; v = c & 0x0F; }
+    else if (c >= 0xF0 && c <= 0xF4) { n = 4; v = c & 0x07; }
+    else return 0;
+
+    if (n > len)
+        return 0;
+    for (size_t i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        v = (v << 6) | (s[i] & 0x3F);
+    }
+    // Reject overlong forms, surrogates and values past U+10FFFF
+    if ((n == 3 && v < 0x800) || (n == 4 && (v < 0x10000 || v > 0x10FFFF)) ||
+        (v >= 0xD800 && v <= 0xDFFF))
+        return 0;
+    *cp = v;
+    return n;
+}
+
+unsigned display_width(const char *name, size_t len)
+{
+    size_t i = ascii_prefix(name, len);
+    unsigned width = (unsigned)i;
+
+    while (i < len) {
+        const unsigned char *p = (const unsigned char *)name + i;
+        if (*p < 0x80) {
+            width++;
+            i++;
+            continue;
+        }
+
+        uint32_t cp;
+        size_t n = decode_utf8(p, len - i, &cp);
+        if (n == 0) {
+            width++;
+            i++;
+        } else {
+            width += codepoint_width(cp);
+            i += n;
+        }
+    }
+    return width;
+}
@@ -0,0 +1,76 @@
+/*
+* liblsv test: --du over entries whose lstat() failed
+*
+* The loader leaves the stat columns of such an entry uninitialized, so
+* this builds an entry table by hand with a leftover mode on each failed
+* entry and checks that lsv_du_visit() neither counts "." and ".." nor
+* reads mode[] for them.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "../src/lsv_int.h"
+
+#define ENTRIES 4
+
+int main(void)
+{
+    static const char *const names[ENTRIES] = { ".", "..", "gone", "file" };
+    char blob[32];
+    uint32_t name_off[ENTRIES], mode[ENTRIES], nlink[ENTRIES] = { 0 };
+    uint16_t name_len[ENTRIES];
+    uint8_t flags[ENTRIES] = { 0 };
+    int64_t size[ENTRIES] = { 0 }, blocks[ENTRIES] = { 0 };
+    uint64_t ino[ENTRIES] = { 0 };
+    int stat_err[ENTRIES] = { ENOENT, ENOENT, ENOENT, 0 };
+    size_t used = 0;
+
+    for (size_t i = 0; i < ENTRIES; i++) {
+        name_off[i] = (uint32_t)used;
+        name_len[i] = (uint16_t)strlen(names[i]);
+        memcpy(blob + used, names[i], name_len[i] + 1);
+        used += name_len[i] + 1u;
+    }
+    // Leftovers that used to fool the mode-first test: "." and ".." look
+    // like files, the failed entry like a directory
+    mode[0] = mode[1] = S_IFREG | 0644;
+    mode[2] = S_IFDIR | 0755;
+    mode[3] = S_IFREG | 0644;
+    flags[3] = ENTRY_HAS_STAT;
+    nlink[3] = 1;
+    size[3] = 1000;
+    blocks[3] = 8;
+
+    struct lsv_dir dir = {
+        .path = "t", .count = ENTRIES, .names = blob, .name_off = name_off,
+        .name_len = name_len, .flags = flags, .mode = mode, .nlink = nlink,
+        .size = size, .blocks = blocks, .ino = ino, .stat_err = stat_err,
+    };
+    struct lsv_du *du = lsv_du_new(0);
+    struct lsv_du_totals t = { 0 };
+    if (du == NULL || lsv_du_visit(du, &dir, 0) == -1) {
+        perror("lsv_du");
+        return 1;
+    }
+    lsv_du_leave(du, &dir, 0, &t, NULL);
+    lsv_du_free(du);
+
+    int failed = 0;
+    if (t.entries != 2) {
+        fprintf(stderr, "du_test: entries = %llu, want 2\n", (unsigned long long)t.entries);
+        failed = 1;
+    }
+    if (t.bytes != 1000 || t.blocks != 8) {
+        fprintf(stderr, "du_test: bytes = %llu blocks = %llu, want 1000 and 8\n",
+                (unsigned long long)t.bytes, (unsigned long long)t.blocks);
+        failed = 1;
+    }
+    if (!failed)
+        printf("du_test: ok\n");
+    return failed;
+}